@@ -233,6 +233,13 @@
  //#define JUCE_USE_CAMERA 1
 #endif
 
+//==============================================================================
+// kv_core flags:
+
+#ifndef    KV_TIMESCALE_HIGH_PRECISION
+ //#define KV_TIMESCALE_HIGH_PRECISION 0
+#endif
+
 //==============================================================================
 // kv_engines flags:
 
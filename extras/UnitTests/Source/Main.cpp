@@ -19,6 +19,31 @@
 
 #include "../JuceLibraryCode/JuceHeader.h"
 
+//=============================================================================
+// Counts heap allocations, for tests of code which mustn't allocate. On Linux
+// malloc itself is wrapped, so HeapBlock storage counts as well as new
+static std::atomic<int> sNumAllocations { 0 };
+
+#if JUCE_LINUX
+extern "C" void* __libc_malloc (size_t);
+extern "C" void* __libc_calloc (size_t, size_t);
+extern "C" void* __libc_realloc (void*, size_t);
+
+extern "C" void* malloc (size_t size) noexcept              { ++sNumAllocations; return __libc_malloc (size); }
+extern "C" void* calloc (size_t num, size_t size) noexcept  { ++sNumAllocations; return __libc_calloc (num, size); }
+extern "C" void* realloc (void* ptr, size_t size) noexcept  { ++sNumAllocations; return __libc_realloc (ptr, size); }
+#else
+void* operator new (size_t size)
+{
+    ++sNumAllocations;
+    if (void* ptr = std::malloc (size > 0 ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete (void* ptr) noexcept { std::free (ptr); }
+#endif
+
 namespace kv {
 
 class TestRunner : public UnitTestRunner
@@ -57,6 +82,2412 @@ public:
 
 static DummyTest sDummyTest;
 
+class MatrixStateTest : public UnitTest
+{
+public:
+    MatrixStateTest() : UnitTest ("matrix-state") { }
+    void runTest() override
+    {
+        Random random (2600);
+
+        for (const int numColumns : { 1, 63, 64, 65, 100, 130 })
+        {
+            beginTest ("packed round trip " + String (numColumns) + " columns");
+            MatrixState matrix (37, numColumns);
+            for (int i = 0; i < 200; ++i)
+                matrix.connect (random.nextInt (37), random.nextInt (numColumns));
+            matrix.connect (36, numColumns - 1);
+
+            const ValueTree tree (matrix.createValueTree());
+            expect (tree.hasProperty ("packed"));
+            expect (! tree.hasProperty ("toggled"));
+
+            MatrixState restored;
+            restored.restoreFromValueTree (tree);
+            expect (restored == matrix);
+            expectEquals (restored.getNumConnections(), matrix.getNumConnections());
+
+            beginTest ("legacy toggled string " + String (numColumns) + " columns");
+            BigInteger toggled;
+            for (int row = 0; row < matrix.getNumRows(); ++row)
+                for (int col = 0; col < numColumns; ++col)
+                    if (matrix.connected (row, col))
+                        toggled.setBit (matrix.getIndexForCell (row, col));
+
+            ValueTree legacy ("matrix");
+            legacy.setProperty ("numRows", matrix.getNumRows(), nullptr);
+            legacy.setProperty ("numColumns", numColumns, nullptr);
+            legacy.setProperty ("toggled", toggled.toString (2), nullptr);
+
+            MatrixState fromLegacy;
+            fromLegacy.restoreFromValueTree (legacy);
+            expect (fromLegacy == matrix);
+
+            beginTest ("out of range cells " + String (numColumns) + " columns");
+            MatrixState empty (3, numColumns);
+            empty.connect (0, numColumns);
+            empty.connect (0, -1);
+            empty.connect (3, 0);
+            expect (! empty.toggleCell (1, numColumns));
+            expectEquals (empty.getNumConnections(), 0);
+            expect (! empty.connected (1, 0));
+            expect (! empty.isValid (0, numColumns));
+            expect (empty.isValid (2, numColumns - 1));
+        }
+
+        beginTest ("bad packed strings leave the matrix empty");
+        MatrixState matrix (4, 100);
+        matrix.connect (1, 1);
+        expect (! matrix.restoreFromPackedString ("not base64 !"));
+        expectEquals (matrix.getNumConnections(), 0);
+    }
+};
+
+static MatrixStateTest sMatrixStateTest;
+
+class MatrixRouterTest : public UnitTest
+{
+public:
+    MatrixRouterTest() : UnitTest ("matrix-router") { }
+    void runTest() override
+    {
+        enum { numChannels = 8, numSamples = 64 };
+        AudioBuffer<float> ins (numChannels, numSamples), outs (numChannels, numSamples);
+        for (int c = 0; c < numChannels; ++c)
+            FloatVectorOperations::fill (ins.getWritePointer (c), (float) (c + 1), numSamples);
+
+        beginTest ("plan mixes connected inputs with their gains");
+        MatrixState matrix (numChannels, numChannels);
+        HeapBlock<float> gains ((size_t) (numChannels * numChannels));
+        for (int i = 0; i < numChannels * numChannels; ++i)
+            gains[i] = 0.5f;
+        matrix.connect (0, 0);
+        matrix.connect (1, 0);
+        matrix.connect (7, 3);
+        matrix.connect (2, 5);
+        gains [matrix.getIndexForCell (2, 5)] = 1.f;
+
+        MatrixRoutingPlan plan (matrix, gains);
+        expectEquals (plan.getNumRoutes(), 4);
+        expectEquals (plan.getNumRoutes (0), 2);
+        expectEquals (plan.getNumRoutes (1), 0);
+        expectEquals (plan.getRoutes (3)->input, 7);
+
+        outs.clear();
+        FloatVectorOperations::fill (outs.getWritePointer (1), 99.f, numSamples);
+        plan.process (ins.getArrayOfReadPointers(), numChannels,
+                      outs.getArrayOfWritePointers(), numChannels, numSamples);
+        expectEquals (outs.getSample (0, 10), 1.5f);
+        expectEquals (outs.getSample (1, 10), 0.f);
+        expectEquals (outs.getSample (3, numSamples - 1), 4.f);
+        expectEquals (outs.getSample (5, 0), 3.f);
+
+        beginTest ("inputs past the channel count are skipped");
+        plan.process (ins.getArrayOfReadPointers(), 4,
+                      outs.getArrayOfWritePointers(), numChannels, numSamples);
+        expectEquals (outs.getSample (3, 0), 0.f);
+        expectEquals (outs.getSample (0, 0), 1.5f);
+
+        beginTest ("router publishes the latest plan");
+        MatrixRouter router;
+        expect (router.acquire() == nullptr);
+
+        MatrixState single (numChannels, numChannels);
+        single.connect (2, 0);
+        router.update (single);
+        single.clear();
+        single.connect (4, 0);
+        router.update (single);
+
+        const MatrixRoutingPlan* active = router.acquire();
+        expect (active != nullptr);
+        expectEquals (active->getRoutes (0)->input, 4);
+        expect (router.acquire() == active);
+        router.collectGarbage();
+
+        beginTest ("audio thread only ever sees whole plans");
+        AudioThread audio (router, ins);
+        audio.startThread (8);
+
+        for (int i = 0; i < 2000; ++i)
+        {
+            single.clear();
+            single.connect (i % numChannels, 0);
+            router.update (single);
+        }
+
+        audio.stopThread (-1);
+        router.collectGarbage();
+
+        expectEquals (audio.numBad.load(), 0);
+        expect (audio.numBlocks.load() > 0);
+    }
+
+private:
+    struct AudioThread : public Thread
+    {
+        AudioThread (MatrixRouter& r, const AudioBuffer<float>& i)
+            : Thread ("matrix-router"), router (r), ins (i) { }
+
+        void run() override
+        {
+            AudioBuffer<float> out (1, ins.getNumSamples());
+            while (! threadShouldExit())
+            {
+                if (const MatrixRoutingPlan* plan = router.acquire())
+                {
+                    plan->process (ins.getArrayOfReadPointers(), ins.getNumChannels(),
+                                   out.getArrayOfWritePointers(), 1, out.getNumSamples());
+                    const float expected = (float) (plan->getRoutes (0)->input + 1);
+                    if (plan->getNumRoutes (0) != 1 || out.getSample (0, out.getNumSamples() - 1) != expected)
+                        ++numBad;
+                }
+
+                ++numBlocks;
+            }
+        }
+
+        MatrixRouter& router;
+        const AudioBuffer<float>& ins;
+        std::atomic<int> numBad { 0 }, numBlocks { 0 };
+    };
+};
+
+static MatrixRouterTest sMatrixRouterTest;
+
+class ArcTopologyTest : public UnitTest
+{
+public:
+    ArcTopologyTest() : UnitTest ("arc-topology") { }
+    void runTest() override
+    {
+        enum { numNodes = 60 };
+        Random random (2800);
+        ArcTopology topology;
+        OwnedArray<Arc> arcs;
+
+        beginTest ("cycles are rejected and the rest are added");
+        for (int i = 0; i < 400; ++i)
+        {
+            const uint32 source = (uint32) random.nextInt (numNodes);
+            const uint32 dest   = (uint32) random.nextInt (numNodes);
+            const bool cycle    = reaches (arcs, dest, source);
+            const int numBefore = topology.getNumNodes();
+
+            expectEquals (topology.wouldCreateCycle (source, dest), cycle);
+            expectEquals (topology.addArc (source, dest), ! cycle);
+            if (! cycle)
+                arcs.add (new Arc (source, 0, dest, 0));
+            else
+                expectEquals (topology.getNumNodes(), numBefore);
+        }
+
+        expectOrder (topology, arcs);
+        expectInputs (topology, arcs);
+
+        beginTest ("order holds as arcs and nodes are removed");
+        for (int i = 0; i < 100 && arcs.size() > 0; ++i)
+        {
+            const int index = random.nextInt (arcs.size());
+            topology.removeArc (arcs[index]->sourceNode, arcs[index]->destNode);
+            arcs.remove (index);
+        }
+
+        for (uint32 nodeId = 0; nodeId < (uint32) numNodes; nodeId += 7)
+        {
+            topology.removeNode (nodeId);
+            for (int i = arcs.size(); --i >= 0;)
+                if (arcs[i]->sourceNode == nodeId || arcs[i]->destNode == nodeId)
+                    arcs.remove (i);
+        }
+
+        expect (! topology.containsNode (7));
+        expectOrder (topology, arcs);
+        expectInputs (topology, arcs);
+
+        for (int i = 0; i < 200; ++i)
+        {
+            const uint32 source = (uint32) random.nextInt (numNodes);
+            const uint32 dest   = (uint32) random.nextInt (numNodes);
+            if (topology.addArc (source, dest))
+                arcs.add (new Arc (source, 0, dest, 0));
+        }
+
+        expectOrder (topology, arcs);
+        expectInputs (topology, arcs);
+
+        beginTest ("ArcTable searches diamonds in linear time");
+        OwnedArray<Arc> diamonds;
+        for (uint32 level = 0; level < 64; ++level)
+        {
+            const uint32 top = level * 3, left = top + 1, right = top + 2, bottom = top + 3;
+            diamonds.add (new Arc (top, 0, left, 0));
+            diamonds.add (new Arc (top, 0, right, 0));
+            diamonds.add (new Arc (left, 0, bottom, 0));
+            diamonds.add (new Arc (right, 0, bottom, 0));
+        }
+
+        ArcTable<Arc> table (diamonds);
+        expect (table.isAnInputTo (0, 64 * 3));
+        expect (! table.isAnInputTo (64 * 3, 0));
+        expect (! table.isAnInputTo (1, 2));
+    }
+
+private:
+    static bool reaches (const OwnedArray<Arc>& arcs, uint32 from, uint32 to)
+    {
+        Array<uint32> pending, seen;
+        pending.add (from);
+        seen.add (from);
+
+        while (pending.size() > 0)
+        {
+            const uint32 nodeId = pending.removeAndReturn (pending.size() - 1);
+            if (nodeId == to)
+                return true;
+
+            for (const auto* arc : arcs)
+                if (arc->sourceNode == nodeId && ! seen.contains (arc->destNode))
+                {
+                    seen.add (arc->destNode);
+                    pending.add (arc->destNode);
+                }
+        }
+
+        return false;
+    }
+
+    void expectOrder (const ArcTopology& topology, const OwnedArray<Arc>& arcs)
+    {
+        Array<uint32> order;
+        topology.getProcessingOrder (order);
+        expectEquals (order.size(), topology.getNumNodes());
+
+        for (const auto* arc : arcs)
+            expect (order.indexOf (arc->sourceNode) < order.indexOf (arc->destNode));
+    }
+
+    void expectInputs (const ArcTopology& topology, const OwnedArray<Arc>& arcs)
+    {
+        ArcTable<Arc> table (arcs);
+        for (uint32 a = 0; a < 60; a += 3)
+        {
+            for (uint32 b = 1; b < 60; b += 4)
+            {
+                const bool expected = a != b && reaches (arcs, a, b);
+                expectEquals (topology.isAnInputTo (a, b), expected);
+                expectEquals (table.isAnInputTo (a, b), expected);
+            }
+        }
+    }
+};
+
+static ArcTopologyTest sArcTopologyTest;
+
+class GraphRenderSchedulerTest : public UnitTest
+{
+public:
+    GraphRenderSchedulerTest() : UnitTest ("graph-render-scheduler") { }
+    void runTest() override
+    {
+        testOrdering();
+        testPlanSwap();
+        testDeadline();
+        testScaling();
+    }
+
+private:
+    enum { maxNodes = 512 };
+
+    /** Stamps each node with the order it started and finished in */
+    struct OrderRenderer : public GraphRenderScheduler::Renderer
+    {
+        OrderRenderer() { reset(); }
+
+        void reset()
+        {
+            for (int i = 0; i < maxNodes; ++i)
+                started[i] = finished[i] = 0;
+            counter = 0;
+        }
+
+        void renderNode (uint32 nodeId) override
+        {
+            jassert (nodeId < maxNodes);
+            started [nodeId] = ++counter;
+            for (volatile int i = 0; i < 200; ++i) { }
+            finished [nodeId] = ++counter;
+        }
+
+        std::atomic<int> started [maxNodes], finished [maxNodes];
+        std::atomic<int> counter;
+    };
+
+    void expectOrdered (const OrderRenderer& renderer, const Array<uint32>& nodeIds,
+                        const Array<GraphRenderScheduler::Connection>& connections)
+    {
+        for (const auto nodeId : nodeIds)
+            expect (renderer.finished [nodeId] > renderer.started [nodeId]);
+        for (const auto& c : connections)
+            expect (renderer.finished [c.sourceNode] < renderer.started [c.destNode]);
+    }
+
+    static void makeGraph (Random& random, uint32 firstId, int numNodes, Array<uint32>& nodeIds,
+                           Array<GraphRenderScheduler::Connection>& connections)
+    {
+        nodeIds.clearQuick();
+        connections.clearQuick();
+        for (int i = 0; i < numNodes; ++i)
+            nodeIds.add (firstId + (uint32) i);
+
+        // arcs only go from lower to higher IDs, so there are no cycles
+        for (int i = 0; i < numNodes * 2; ++i)
+        {
+            const int a = random.nextInt (numNodes), b = random.nextInt (numNodes);
+            if (a != b)
+                connections.add ({ firstId + (uint32) jmin (a, b), firstId + (uint32) jmax (a, b) });
+        }
+    }
+
+    void testOrdering()
+    {
+        beginTest ("nodes render after everything feeding them");
+        Random random (2900);
+        GraphRenderScheduler scheduler (3);
+        OrderRenderer renderer;
+
+        for (int graph = 0; graph < 20; ++graph)
+        {
+            Array<uint32> nodeIds;
+            Array<GraphRenderScheduler::Connection> connections;
+            makeGraph (random, 0, 50 + random.nextInt (200), nodeIds, connections);
+            expect (scheduler.prepare (nodeIds, connections));
+
+            for (int cycle = 0; cycle < 20; ++cycle)
+            {
+                renderer.reset();
+                scheduler.render (renderer);
+                expectEquals (renderer.counter.load(), nodeIds.size() * 2);
+                expectOrdered (renderer, nodeIds, connections);
+            }
+        }
+    }
+
+    void testPlanSwap()
+    {
+        beginTest ("plans swapped while rendering");
+        GraphRenderScheduler scheduler (3);
+        PlanSwapThread audio (scheduler);
+
+        Random random (2901);
+        Array<uint32> nodeIds;
+        Array<GraphRenderScheduler::Connection> connections;
+        makeGraph (random, 0, 100, nodeIds, connections);
+        scheduler.prepare (nodeIds, connections);
+        audio.startThread (8);
+
+        for (int i = 0; i < 500; ++i)
+        {
+            // small graphs use IDs below 256, large ones the IDs above
+            const bool large = (i % 2) == 1;
+            makeGraph (random, large ? 256 : 0, large ? 200 : 100, nodeIds, connections);
+            expect (scheduler.prepare (nodeIds, connections));
+            Thread::sleep (1);
+        }
+
+        audio.stopThread (-1);
+        expectEquals (audio.numBad.load(), 0);
+        expect (audio.numCycles.load() > 0);
+    }
+
+    struct PlanSwapThread : public Thread
+    {
+        PlanSwapThread (GraphRenderScheduler& s) : Thread ("plan-swap"), scheduler (s) { }
+
+        void run() override
+        {
+            OrderRenderer renderer;
+            while (! threadShouldExit())
+            {
+                renderer.reset();
+                scheduler.render (renderer);
+
+                // every node of exactly one of the graphs
+                int numSmall = 0, numLarge = 0;
+                for (int i = 0; i < maxNodes; ++i)
+                {
+                    if (renderer.finished[i] == 0)
+                        continue;
+                    if (i < 256)
+                        ++numSmall;
+                    else
+                        ++numLarge;
+                }
+
+                if (! ((numSmall == 100 && numLarge == 0) || (numSmall == 0 && numLarge == 200)))
+                    ++numBad;
+                ++numCycles;
+            }
+        }
+
+        GraphRenderScheduler& scheduler;
+        std::atomic<int> numBad { 0 }, numCycles { 0 };
+    };
+
+    struct SleepRenderer : public GraphRenderScheduler::Renderer
+    {
+        void renderNode (uint32) override { Thread::sleep (2); }
+    };
+
+    void testDeadline()
+    {
+        beginTest ("deadline misses are reported");
+        GraphRenderScheduler scheduler (1);
+        SleepRenderer renderer;
+
+        Array<uint32> nodeIds ({ 1, 2, 3 });
+        Array<GraphRenderScheduler::Connection> connections;
+        connections.add ({ 1, 2 });
+        connections.add ({ 2, 3 });
+        expect (scheduler.prepare (nodeIds, connections));
+
+        scheduler.setDeadline (0.001);
+        for (int i = 0; i < 5; ++i)
+            scheduler.render (renderer);
+
+        GraphRenderScheduler::Report report;
+        scheduler.getReport (report);
+        expectEquals (report.numNodes, 3);
+        expectEquals (report.numThreads, 2);
+        expectEquals ((int) report.numCycles, 5);
+        expectEquals ((int) report.numDeadlineMisses, 5);
+        expect (report.maxCycleTime >= 0.006);
+        expectEquals (report.nodes.size(), 3);
+        for (const auto& node : report.nodes)
+            expect (node.maxTime >= 0.002);
+
+        scheduler.setDeadline (10.0);
+        scheduler.render (renderer);
+        scheduler.setDeadline (0.0);
+        scheduler.render (renderer);
+        scheduler.getReport (report);
+        expectEquals ((int) report.numCycles, 7);
+        expectEquals ((int) report.numDeadlineMisses, 5);
+    }
+
+    /** Some arithmetic standing in for a plugin */
+    struct BusyRenderer : public GraphRenderScheduler::Renderer
+    {
+        void renderNode (uint32 nodeId) override
+        {
+            float* const data = buffers [nodeId % maxNodes];
+            for (int pass = 0; pass < 8; ++pass)
+                for (int i = 0; i < 512; ++i)
+                    data[i] = std::sin (data[i] + (float) (nodeId + (uint32) i));
+        }
+
+        float buffers [maxNodes][512] = {};
+    };
+
+    void testScaling()
+    {
+        // 32 tracks of 4 plugins each, feeding a master bus
+        Array<uint32> nodeIds;
+        Array<GraphRenderScheduler::Connection> connections;
+        const uint32 master = 32 * 4;
+        nodeIds.add (master);
+
+        for (uint32 track = 0; track < 32; ++track)
+        {
+            for (uint32 slot = 0; slot < 4; ++slot)
+            {
+                nodeIds.add (track * 4 + slot);
+                connections.add ({ track * 4 + slot, slot < 3 ? track * 4 + slot + 1 : master });
+            }
+        }
+
+        double singleTime = 0.0;
+        const int maxThreads = jmin (8, SystemStats::getNumCpus());
+
+        for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+        {
+            beginTest ("32 tracks on " + String (numThreads) + " threads");
+            GraphRenderScheduler scheduler (numThreads - 1);
+            std::unique_ptr<BusyRenderer> renderer (new BusyRenderer());
+            expect (scheduler.prepare (nodeIds, connections));
+            scheduler.render (*renderer);
+
+            const double start = Time::getMillisecondCounterHiRes();
+            for (int i = 0; i < 200; ++i)
+                scheduler.render (*renderer);
+            const double time = (Time::getMillisecondCounterHiRes() - start) / 200.0;
+
+            if (numThreads == 1)
+                singleTime = time;
+
+            GraphRenderScheduler::Report report;
+            scheduler.getReport (report);
+            expectEquals ((int) report.numCycles, 201);
+            logMessage (String (time, 3) + " ms per cycle, "
+                + String (singleTime / time, 2) + "x one thread");
+        }
+    }
+};
+
+static GraphRenderSchedulerTest sGraphRenderSchedulerTest;
+
+class GraphBufferPlannerTest : public UnitTest
+{
+public:
+    GraphBufferPlannerTest() : UnitTest ("graph-buffer-planner") { }
+    void runTest() override
+    {
+        Random random (3000);
+
+        beginTest ("live buffers never share a slot");
+        for (int iteration = 0; iteration < 100; ++iteration)
+        {
+            const int numNodes = 2 + random.nextInt (30);
+            Array<uint32> order;
+            Array<GraphBufferPlanner::Output> outputs;
+            Array<GraphBufferPlanner::Connection> connections;
+
+            // ports 0 and 1 are audio, port 2 is midi, port 3 is control
+            for (int i = 0; i < numNodes; ++i)
+            {
+                order.add (100 + (uint32) i);
+                for (uint32 port = 0; port < 4; ++port)
+                    outputs.add ({ 100 + (uint32) i, port, getPortType (port) });
+            }
+
+            for (int i = random.nextInt (numNodes * 3); --i >= 0;)
+            {
+                const int a = random.nextInt (numNodes), b = random.nextInt (numNodes);
+                if (a != b)
+                    connections.add ({ 100 + (uint32) jmin (a, b), (uint32) random.nextInt (3),
+                                       100 + (uint32) jmax (a, b) });
+            }
+
+            GraphBufferPlanner planner;
+            planner.plan (order, outputs, connections);
+
+            // the slots a node reads must not be the ones it writes
+            for (const auto& c : connections)
+            {
+                const int input = planner.getBufferIndex (c.sourceNode, c.sourcePort);
+                expect (input >= 0);
+                for (uint32 port = 0; port < 3; ++port)
+                    if (GraphBufferPlanner::getBufferKind (getPortType (port)) == GraphBufferPlanner::getBufferKind (getPortType (c.sourcePort)))
+                        expect (planner.getBufferIndex (c.destNode, port) != input);
+            }
+
+            // outputs alive at the same step are in different slots
+            int peak[GraphBufferPlanner::NumBufferKinds] = { 0, 0 };
+            for (int step = 0; step < numNodes; ++step)
+            {
+                Array<int> live[GraphBufferPlanner::NumBufferKinds];
+                for (int node = 0; node <= step; ++node)
+                {
+                    for (uint32 port = 0; port < 3; ++port)
+                    {
+                        if (getLastRead (connections, 100 + (uint32) node, port, node) < step)
+                            continue;
+                        const int kind = GraphBufferPlanner::getBufferKind (getPortType (port));
+                        const int slot = planner.getBufferIndex (100 + (uint32) node, port);
+                        expect (! live[kind].contains (slot));
+                        live[kind].add (slot);
+                    }
+                }
+
+                for (int kind = 0; kind < GraphBufferPlanner::NumBufferKinds; ++kind)
+                    peak[kind] = jmax (peak[kind], live[kind].size());
+            }
+
+            expectEquals (planner.getBufferIndex (100, 3), -1);
+            expectEquals (planner.getNumBuffers (GraphBufferPlanner::AudioBuffers), peak [GraphBufferPlanner::AudioBuffers]);
+            expectEquals (planner.getNumBuffers (GraphBufferPlanner::MidiBuffers), peak [GraphBufferPlanner::MidiBuffers]);
+            expectEquals (planner.getNumOutputs (GraphBufferPlanner::AudioBuffers), numNodes * 2);
+            expectEquals (planner.getNumOutputs (GraphBufferPlanner::MidiBuffers), numNodes);
+        }
+
+        beginTest ("a chain reuses two buffers");
+        Array<uint32> order;
+        Array<GraphBufferPlanner::Output> outputs;
+        Array<GraphBufferPlanner::Connection> connections;
+        for (uint32 i = 0; i < 16; ++i)
+        {
+            order.add (i);
+            outputs.add ({ i, 0, PortType::Audio });
+            if (i > 0)
+                connections.add ({ i - 1, 0, i });
+        }
+
+        GraphBufferPlanner planner;
+        planner.plan (order, outputs, connections);
+        expectEquals (planner.getNumBuffers (GraphBufferPlanner::AudioBuffers), 2);
+        expectEquals ((int) planner.getAudioBytesSaved (512), (int) (14 * 512 * sizeof (float)));
+
+        AudioBuffer<float> buffer;
+        planner.createAudioBuffer (buffer, 512);
+        expectEquals (buffer.getNumChannels(), 2);
+    }
+
+private:
+    static PortType getPortType (uint32 port)
+    {
+        return port < 2 ? PortType::Audio : (port == 2 ? PortType::Midi : PortType::Control);
+    }
+
+    static int getLastRead (const Array<GraphBufferPlanner::Connection>& connections,
+                            uint32 nodeId, uint32 port, int step)
+    {
+        for (const auto& c : connections)
+            if (c.sourceNode == nodeId && c.sourcePort == port)
+                step = jmax (step, (int) c.destNode - 100);
+        return step;
+    }
+};
+
+static GraphBufferPlannerTest sGraphBufferPlannerTest;
+
+class LinkedListTest : public UnitTest
+{
+public:
+    LinkedListTest() : UnitTest ("linked-list") { }
+    void runTest() override
+    {
+        int numAlive = 0;
+
+        beginTest ("removed nodes live until clear");
+        {
+            LinkedList<Item> list;
+            list.setScoped (true);
+            list.reserve (8);
+            expectEquals (list.capacity(), 8);
+
+            Item* items[8];
+            for (int i = 0; i < 8; ++i)
+                list.append (items[i] = list.create (i, numAlive));
+            expectEquals (numAlive, 8);
+
+            list.remove (items[3]);
+            list.remove (items[5]);
+            expectEquals (list.count(), 6);
+            expectEquals (numAlive, 8);
+            expectEquals (items[3]->value, 3);
+            expect (items[3]->isPooled());
+
+            // storage isn't reused while removed nodes are still alive
+            list.setFixedCapacity (true);
+            expect (list.create (100, numAlive) == nullptr);
+
+            list.clear();
+            expectEquals (numAlive, 0);
+            expectEquals (list.count(), 0);
+
+            // and is reused once they are gone
+            for (int i = 0; i < 8; ++i)
+                if (Item* item = list.create (i, numAlive))
+                    list.append (item);
+            expectEquals (list.count(), 8);
+            expect (list.create (8, numAlive) == nullptr);
+            expectEquals (list.capacity(), 8);
+        }
+        expectEquals (numAlive, 0);
+
+        beginTest ("recycled storage is reused");
+        {
+            LinkedList<Item> list;
+            list.setScoped (true);
+            list.reserve (4);
+            list.setFixedCapacity (true);
+            list.append (new Item (-1, numAlive));
+            list.remove (list.first());
+
+            for (int i = 0; i < 1000; ++i)
+            {
+                list.recycle();
+                Item* item = list.create (i, numAlive);
+                expect (item != nullptr);
+                if (item == nullptr)
+                    break;
+
+                list.append (item);
+                list.remove (item);
+            }
+
+            // pooled nodes are gone, the heap node lives until clear()
+            list.recycle();
+            expectEquals (list.count(), 0);
+            expectEquals (list.capacity(), 4);
+            expectEquals (numAlive, 1);
+        }
+        expectEquals (numAlive, 0);
+
+        beginTest ("pooled and heap nodes mix");
+        {
+            LinkedList<Item> list;
+            list.setScoped (true);
+            list.append (list.create (0, numAlive));
+            list.append (new Item (1, numAlive));
+            expect (! list.last()->isPooled());
+            list.remove (list.first());
+            list.remove (list.first());
+            expectEquals (numAlive, 2);
+        }
+        expectEquals (numAlive, 0);
+
+        beginTest ("position index matches the list");
+        {
+            Random random (3200);
+            LinkedList<Item> list;
+            list.setScoped (true);
+            list.setIndexed (true);
+            Array<Item*> expected;
+
+            for (int i = 0; i < 5000; ++i)
+            {
+                const int action = random.nextInt (3);
+                if (action < 2 || expected.size() == 0)
+                {
+                    // insert anywhere, including both ends
+                    Item* item = new Item (i, numAlive);
+                    const int index = random.nextInt (expected.size() + 1);
+                    if (index == expected.size())
+                        list.append (item);
+                    else if (random.nextBool())
+                        list.insertBefore (item, expected [index]);
+                    else if (index > 0)
+                        list.insertAfter (item, expected [index - 1]);
+                    else
+                        list.prepend (item);
+                    expected.insert (index, item);
+                }
+                else
+                {
+                    const int index = random.nextInt (expected.size());
+                    list.remove (expected [index]);
+                    expected.remove (index);
+                }
+
+                if (i % 100 == 0 || i == 4999)
+                {
+                    expectEquals (list.count(), expected.size());
+                    for (int j = 0; j < expected.size(); ++j)
+                    {
+                        expect (list.at (j) == expected [j]);
+                        expectEquals (list.find (expected [j]), j);
+                    }
+                    expect (list.at (expected.size()) == nullptr);
+                }
+            }
+
+            // turning the index off and on again rebuilds it
+            list.setIndexed (false);
+            expect (list.at (expected.size() / 2) == expected [expected.size() / 2]);
+            list.setIndexed (true);
+            for (int j = 0; j < expected.size(); ++j)
+                expectEquals (list.find (expected [j]), j);
+
+            LinkedList<Item> other;
+            other.setScoped (true);
+            other.setIndexed (true);
+            other.append (new Item (0, numAlive));
+            expectEquals (list.find (other.first()), -1);
+        }
+        expectEquals (numAlive, 0);
+
+        beginTest ("findLast walks the index");
+        for (const bool indexed : { false, true })
+        {
+            LinkedList<Item> list;
+            list.setScoped (true);
+            list.setIndexed (indexed);
+            for (int i = 0; i < 100; ++i)
+                list.append (list.create (i * 2, numAlive));
+
+            for (int value = -1; value < 201; ++value)
+            {
+                Item* item = list.findLast ([value] (const Item& i) { return i.value <= value; });
+                if (value < 0)
+                    expect (item == nullptr);
+                else
+                    expectEquals (item->value, jmin (198, value - (value % 2)));
+            }
+        }
+        expectEquals (numAlive, 0);
+    }
+
+private:
+    struct Item : public LinkedList<Item>::Link
+    {
+        Item (int v, int& alive) : value (v), numAlive (alive) { ++numAlive; }
+        ~Item() { --numAlive; }
+        const int value;
+        int& numAlive;
+    };
+};
+
+static LinkedListTest sLinkedListTest;
+
+class TimeScaleSnapshotTest : public UnitTest
+{
+public:
+    TimeScaleSnapshotTest() : UnitTest ("timescale-snapshot") { }
+    void runTest() override
+    {
+        TimeScale ts;
+        ts.reserve (64);
+        for (int i = 1; i < 32; ++i)
+            ts.addNode ((uint64) i * 88200, 90.f + (float) i);
+
+        TimeScale::Node* node = ts.nodes().at (16);
+
+        beginTest ("editing a reserved scale doesn't allocate");
+        const int numAllocations = sNumAllocations.load();
+        for (int i = 0; i < 1000; ++i)
+        {
+            node->tempo = 80.f + (float) (i % 100);
+            ts.updateNode (node);
+        }
+
+        for (int i = 0; i < 16; ++i)
+            ts.removeNode (ts.addNode ((uint64) (40 + i) * 88200, 120.f));
+
+        expectEquals (sNumAllocations.load() - numAllocations, 0);
+
+        beginTest ("adding and removing nodes for ever doesn't allocate");
+        const int numBefore = sNumAllocations.load();
+        for (int i = 0; i < 20000; ++i)
+            ts.removeNode (ts.addNode ((uint64) (40 + i % 16) * 88200, 60.f + (float) (i % 7)));
+
+        expectEquals (sNumAllocations.load() - numBefore, 0);
+        expectEquals (ts.nodes().count(), 28);
+
+        beginTest ("held snapshots aren't rewritten");
+        TimeScale::Snapshot::Ptr held = ts.getSnapshot();
+        expectEquals (held->getNumSegments(), ts.nodes().count());
+        expectEquals (held->getSegment (16).tempo, 179.f);
+
+        for (int i = 0; i < 10; ++i)
+        {
+            node->tempo = 200.f + (float) i;
+            ts.updateNode (node);
+        }
+
+        expectEquals (held->getSegment (16).tempo, 179.f);
+        expectEquals (ts.getSnapshot()->getSegment (16).tempo, 209.f);
+    }
+};
+
+static TimeScaleSnapshotTest sTimeScaleSnapshotTest;
+
+class TimeScaleBatchTest : public UnitTest
+{
+public:
+    TimeScaleBatchTest() : UnitTest ("timescale-batch") { }
+    void runTest() override
+    {
+        TimeScale ts;
+        Random random (4321);
+        for (int i = 1; i < 1000; ++i)
+            ts.addNode ((uint64) i * 44100 + (uint64) random.nextInt (44100), 40.f + (float) random.nextInt (200));
+
+        const uint64 lastTick  = ts.nodes().last()->tick + 100000;
+        const uint64 lastFrame = ts.nodes().last()->frame + 100000;
+        const int numValues = 20000;
+        HeapBlock<uint64> ticks (numValues), frames (numValues), results (numValues);
+
+        for (const bool sorted : { true, false })
+        {
+            for (int i = 0; i < numValues; ++i)
+            {
+                ticks[i]  = (uint64) random.nextInt64() % lastTick;
+                frames[i] = (uint64) random.nextInt64() % lastFrame;
+            }
+
+            if (sorted)
+            {
+                std::sort (ticks.get(), ticks.get() + numValues);
+                std::sort (frames.get(), frames.get() + numValues);
+            }
+
+            beginTest (String (sorted ? "sorted" : "random") + " framesFromTicks matches frameFromTick");
+            ts.framesFromTicks (ticks, results, numValues);
+            int numWrong = 0;
+            for (int i = 0; i < numValues; ++i)
+                if (results[i] != ts.frameFromTick (ticks[i]))
+                    ++numWrong;
+            expectEquals (numWrong, 0);
+
+            beginTest (String (sorted ? "sorted" : "random") + " ticksFromFrames matches tickFromFrame");
+            ts.ticksFromFrames (frames, results, numValues);
+            numWrong = 0;
+            for (int i = 0; i < numValues; ++i)
+                if (results[i] != ts.tickFromFrame (frames[i]))
+                    ++numWrong;
+            expectEquals (numWrong, 0);
+        }
+
+        beginTest ("node boundaries");
+        int numValuesAtNodes = 0;
+        for (auto* node = ts.nodes().first(); node && numValuesAtNodes + 3 <= numValues; node = node->next())
+        {
+            for (const int64 offset : { -1, 0, 1 })
+            {
+                ticks[numValuesAtNodes]  = (uint64) jmax ((int64) 0, (int64) node->tick + offset);
+                frames[numValuesAtNodes] = (uint64) jmax ((int64) 0, (int64) node->frame + offset);
+                ++numValuesAtNodes;
+            }
+        }
+
+        ts.framesFromTicks (ticks, results, numValuesAtNodes);
+        for (int i = 0; i < numValuesAtNodes; ++i)
+            expectEquals ((int64) results[i], (int64) ts.frameFromTick (ticks[i]));
+
+        ts.ticksFromFrames (frames, results, numValuesAtNodes);
+        for (int i = 0; i < numValuesAtNodes; ++i)
+            expectEquals ((int64) results[i], (int64) ts.tickFromFrame (frames[i]));
+    }
+};
+
+static TimeScaleBatchTest sTimeScaleBatchTest;
+
+class TimeScaleMarkerTest : public UnitTest
+{
+public:
+    TimeScaleMarkerTest() : UnitTest ("timescale-markers") { }
+    void runTest() override
+    {
+        TimeScale ts;
+        Random random (2468);
+        for (int i = 0; i < 500; ++i)
+            ts.addMarker ((uint64) random.nextInt (50000000), "marker " + std::to_string (i % 5),
+                          (i % 2) == 0 ? "#ff8800" : "#80112233");
+
+        beginTest ("markersInRange matches a linear scan");
+        checkRanges (ts, random);
+
+        TimeScale::Marker* marker = ts.markers().first()->next();
+        expectEquals (ts.markersInRange (marker->frame, marker->frame + 1).size(), 1);
+        expect (ts.markersInRange (marker->frame, marker->frame).isEmpty());
+        expect (ts.markersInRange (marker->frame + 1, marker->next()->frame).isEmpty());
+
+        beginTest ("markersInRange after removing markers");
+        for (int i = 0; marker != nullptr; ++i)
+        {
+            TimeScale::Marker* next = marker->next();
+            if (i % 3 == 0)
+                ts.removeMarker (marker);
+            marker = next;
+        }
+
+        checkRanges (ts, random);
+
+        beginTest ("marker text is interned");
+        expectInterned (ts);
+        TimeScale copy (ts);
+        expectInterned (copy);
+
+        beginTest ("std::string constructor and accessors");
+        const TimeScale::Marker compatible (0, 1, std::string ("intro"), "#80112233");
+        expect (compatible.textString() == "intro");
+        expect (compatible.colorString() == "#80112233");
+        expectEquals ((int64) compatible.color, (int64) 0x80112233);
+        expect (TimeScale::Marker (0, 1, std::string ("verse")).colorString() == "#545454");
+    }
+
+private:
+    void checkRanges (TimeScale& ts, Random& random)
+    {
+        for (int i = 0; i < 1000; ++i)
+        {
+            const uint64 start = (uint64) random.nextInt (50000000);
+            const uint64 end   = start + (uint64) random.nextInt (4000000);
+
+            int expected = 0;
+            for (auto* marker = ts.markers().first(); marker; marker = marker->next())
+                if (marker->frame >= start && marker->frame < end)
+                    ++expected;
+
+            const TimeScale::MarkerRange range (ts.markersInRange (start, end));
+            expectEquals (range.size(), expected);
+            for (auto* marker : range)
+                expect (marker->frame >= start && marker->frame < end);
+        }
+    }
+
+    // markers with equal text must share one string
+    void expectInterned (TimeScale& ts)
+    {
+        int numShared = 0;
+        for (auto* marker = ts.markers().first(); marker; marker = marker->next())
+        {
+            for (auto* other = marker->next(); other; other = other->next())
+            {
+                if (other->text == marker->text)
+                {
+                    expect (other->text.getCharPointer().getAddress() == marker->text.getCharPointer().getAddress());
+                    ++numShared;
+                    break;
+                }
+            }
+        }
+
+        expect (numShared > 0);
+    }
+};
+
+static TimeScaleMarkerTest sTimeScaleMarkerTest;
+
+class TimeScaleSeekTest : public UnitTest
+{
+public:
+    TimeScaleSeekTest() : UnitTest ("timescale-seek") { }
+    void runTest() override
+    {
+        TimeScale ts;
+        Random random (1234);
+        for (int i = 1; i < 10000; ++i)
+            ts.addNode ((uint64) i * 176400, 60.f + (float) random.nextInt (120));
+
+        const uint64 lastTick = ts.nodes().last()->tick;
+
+        beginTest ("random seeks match a linear scan");
+        for (int i = 0; i < 1000; ++i)
+        {
+            const uint64 tick = (uint64) random.nextInt64() % lastTick;
+            TimeScale::Node* expected = ts.nodes().first();
+            for (auto* node = expected; node; node = node->next())
+                if (node->tick <= tick)
+                    expected = node;
+            expect (ts.cursor().seekTick (tick) == expected);
+        }
+
+        beginTest ("1M random conversions over 10k tempo changes");
+        const double start = Time::getMillisecondCounterHiRes();
+        uint64 sum = 0;
+        for (int i = 0; i < 1000000; ++i)
+            sum += ts.frameFromTick ((uint64) random.nextInt64() % lastTick);
+        logMessage (String (Time::getMillisecondCounterHiRes() - start, 2) + " ms");
+        expect (sum > 0);
+    }
+};
+
+static TimeScaleSeekTest sTimeScaleSeekTest;
+
+class TimeScaleDragTest : public UnitTest
+{
+public:
+    TimeScaleDragTest() : UnitTest ("timescale-drag") { }
+    void runTest() override
+    {
+        TimeScale ts;
+        for (int i = 1; i <= 5000; ++i)
+            ts.addNode ((uint64) i * 96000, (i % 2) == 0 ? 100.f : 140.f);
+        expectEquals (ts.nodes().count(), 5001);
+
+        beginTest ("dragging a tempo node in a 5000 node map");
+        for (const int index : { 100, 2500, 4900 })
+        {
+            TimeScale::Node* node = ts.nodes().at (index);
+            const double start = Time::getMillisecondCounterHiRes();
+            for (int i = 0; i < 500; ++i)
+            {
+                node->tempo = 80.f + (float) (i % 100);
+                ts.updateNode (node);
+            }
+
+            logMessage ("node " + String (index) + ": "
+                + String ((Time::getMillisecondCounterHiRes() - start) / 500.0, 4) + " ms per move");
+
+            // the incremental update must land where a full one does
+            TimeScale full (ts);
+            full.updateScale();
+            for (auto* a = ts.nodes().first(), *b = full.nodes().first(); a && b; a = a->next(), b = b->next())
+            {
+                expectEquals ((int64) a->frame, (int64) b->frame);
+                expectEquals ((int64) a->tick, (int64) b->tick);
+                expectEquals (a->pixel, b->pixel);
+            }
+        }
+    }
+};
+
+static TimeScaleDragTest sTimeScaleDragTest;
+
+class TimeScaleGridTest : public UnitTest
+{
+public:
+    TimeScaleGridTest() : UnitTest ("timescale-grid") { }
+    void runTest() override
+    {
+        TimeScale ts;
+        for (int i = 1; i < 100; ++i)
+            ts.addNode ((uint64) i * 132300, 60.f + (float) ((i * 37) % 120), (unsigned short) (3 + i % 3));
+
+        beginTest ("grid lines match per-beat conversion");
+        Random random (1234);
+        const unsigned int lastBeat = ts.nodes().last()->beat + 50;
+        const int lastPixel = ts.pixelFromBeat (lastBeat);
+
+        for (int i = 0; i < 100; ++i)
+        {
+            const int start = random.nextInt (lastPixel);
+            const int end   = start + random.nextInt (3000);
+
+            unsigned int beat = ts.beatFromPixel (start);
+            beat = beat > 0 ? beat - 1 : 0;
+            while (ts.pixelFromBeat (beat) < start)
+                ++beat;
+
+            TimeScale::GridIterator grid (ts, start, end, 4);
+            for (; ts.pixelFromBeat (beat) <= end; ++beat)
+            {
+                while (grid.next() && grid.type() == TimeScale::GridIterator::Subdivision) { }
+                expectEquals (grid.pixel(), ts.pixelFromBeat (beat));
+                expect ((grid.type() == TimeScale::GridIterator::Bar) == ts.beatIsBar (beat));
+                expectEquals ((int) grid.bar(), (int) ts.cursor().seekBeat (beat)->barFromBeat (beat));
+            }
+        }
+
+        beginTest ("bar() past the end");
+        TimeScale::GridIterator grid (ts, 0, lastPixel, 4);
+        unsigned short lastBar = 0;
+        while (grid.next())
+            lastBar = grid.bar();
+        expect (! grid.next());
+        expect (grid.bar() >= lastBar);
+    }
+};
+
+static TimeScaleGridTest sTimeScaleGridTest;
+
+class MidiRenderBufferTest : public UnitTest
+{
+public:
+    MidiRenderBufferTest() : UnitTest ("midi-render-buffer") { }
+    void runTest() override
+    {
+        TimeScale ts;
+        ts.addNode (48000 * 10, 90.f);
+        ts.addNode (48000 * 20, 173.f);
+
+        Random random (99);
+        MidiMessageSequence seq;
+        for (int i = 0; i < 2000; ++i)
+            seq.addEvent (MidiMessage::noteOn (1, random.nextInt (128), (uint8) 100), (double) (i * 240));
+        seq.updateMatchedPairs();
+
+        Midi::RenderBuffer buffer;
+        buffer.compile (seq, ts);
+        expectEquals (buffer.getNumEvents(), seq.getNumEvents());
+
+        beginTest ("blocks emit every event once, at its frame");
+        Midi::RenderBuffer::Cursor cursor;
+        int64 frame = 0;
+        int numEmitted = 0;
+        while (numEmitted < buffer.getNumEvents())
+        {
+            const int numSamples = 64 + random.nextInt (1024);
+            MidiBuffer block;
+            buffer.render (block, cursor, frame, numSamples);
+
+            MidiBuffer::Iterator iter (block);
+            MidiMessage msg; int pos;
+            while (iter.getNextEvent (msg, pos))
+            {
+                const auto& ev = seq.getEventPointer (numEmitted)->message;
+                expectEquals ((int64) frame + pos, (int64) ts.frameFromTick ((uint64) ev.getTimeStamp()));
+                expectEquals (msg.getNoteNumber(), ev.getNoteNumber());
+                ++numEmitted;
+            }
+
+            frame += numSamples;
+        }
+
+        beginTest ("seeking");
+        const int index = buffer.getIndexAtFrame (48000 * 15);
+        MidiBuffer block;
+        buffer.render (block, cursor, buffer.getEvent (index).frame, 1);
+        expectEquals (block.getNumEvents(), 1);
+    }
+};
+
+static MidiRenderBufferTest sMidiRenderBufferTest;
+
+class MidiSequenceLoopTest : public UnitTest
+{
+public:
+    MidiSequenceLoopTest() : UnitTest ("midi-sequence-loop") { }
+
+    struct Player : public MidiSequencePlayer
+    {
+        MidiMessageSequence& sequence() { return *midiSequence; }
+    };
+
+    void runTest() override
+    {
+        Shuttle shuttle;
+        Player player;
+        player.setShuttle (&shuttle);
+        player.setBarLength (1);
+
+        // the last note is still held when the bar wraps
+        const int ticksPerBeat = shuttle.getTimeScale().ticksPerBeat();
+        for (int i = 0; i < 16; ++i)
+        {
+            const double start = i * ticksPerBeat / 4;
+            player.sequence().addEvent (MidiMessage::noteOn (1, 60 + i, (uint8) 100), start);
+            player.sequence().addEvent (MidiMessage::noteOff (1, 60 + i), start + ticksPerBeat / 2);
+        }
+        player.sequence().updateMatchedPairs();
+        player.prepareToPlay (44100.0, 512);
+
+        beginTest ("notes never hang across loops, seeks or stop");
+        Random random (5);
+        play (player, shuttle, random);
+
+        beginTest ("recompiling while playing");
+        Recompiler recompiler (player);
+        recompiler.startThread();
+        play (player, shuttle, random);
+        recompiler.stopThread (-1);
+        expect (recompiler.numCompiles > 0);
+    }
+
+private:
+    struct Recompiler : public Thread
+    {
+        Recompiler (MidiSequencePlayer& p) : Thread ("recompiler"), player (p) { }
+
+        void run() override
+        {
+            while (! threadShouldExit())
+            {
+                player.compileSequence();
+                ++numCompiles;
+            }
+        }
+
+        MidiSequencePlayer& player;
+        std::atomic<int> numCompiles { 0 };
+    };
+
+    void play (Player& player, Shuttle& shuttle, Random& random)
+    {
+        int sounding [128] = { 0 };
+        int numNoteOns = 0;
+
+        shuttle.setPlaying (true);
+        for (int block = 0; block < 1000; ++block)
+        {
+            if (block == 999)
+                shuttle.setPlaying (false);
+            else if (random.nextInt (100) == 0)
+                shuttle.seekAudioFrame (random.nextInt (1000000));
+            shuttle.processCommands();
+
+            const int numSamples = 64 + random.nextInt (700);
+            MidiBuffer buffer;
+            player.renderSequence (numSamples, buffer);
+
+            MidiBuffer::Iterator iter (buffer);
+            MidiMessage msg; int pos;
+            while (iter.getNextEvent (msg, pos))
+            {
+                expect (pos >= 0 && pos < numSamples);
+                if (msg.isNoteOn())
+                {
+                    expectEquals (sounding [msg.getNoteNumber()], 0);
+                    ++sounding [msg.getNoteNumber()];
+                    ++numNoteOns;
+                }
+                else if (msg.isNoteOff() && sounding [msg.getNoteNumber()] > 0)
+                {
+                    --sounding [msg.getNoteNumber()];
+                }
+            }
+
+            shuttle.advance (numSamples);
+        }
+
+        expect (numNoteOns > 16);
+        for (int note = 0; note < 128; ++note)
+            expectEquals (sounding [note], 0);
+    }
+};
+
+static MidiSequenceLoopTest sMidiSequenceLoopTest;
+
+class MidiSequencerTest : public UnitTest
+{
+public:
+    MidiSequencerTest() : UnitTest ("midi-sequencer") { }
+
+    void runTest() override
+    {
+        Shuttle shuttle;
+        shuttle.setPlaying (true);
+        shuttle.processCommands();
+        MidiSequencer sequencer;
+        sequencer.setShuttle (&shuttle);
+
+        // channel and velocity together tag each note with its track
+        Random random (42);
+        const int numTracks = 200;
+        const int mutedTrack = 1, transposedTrack = 2;
+        HeapBlock<int> expectedNotes (numTracks, true), expectedPitches (numTracks, true);
+        for (int track = 0; track < numTracks; ++track)
+        {
+            MidiMessageSequence seq;
+            for (int i = 0; i < 200; ++i)
+            {
+                const int note = 36 + random.nextInt (60);
+                seq.addEvent (MidiMessage::noteOn (1 + track % 16, note, (uint8) (1 + track / 16)),
+                              (double) random.nextInt (Shuttle::PPQ * 64));
+
+                if (track != mutedTrack)
+                {
+                    ++expectedNotes[track];
+                    expectedPitches[track] += track == transposedTrack ? note + 12 : note;
+                }
+            }
+
+            seq.sort();
+            sequencer.addTrack (seq);
+        }
+        expectEquals (sequencer.getNumTracks(), numTracks);
+        sequencer.setTrackMuted (mutedTrack, true);
+        sequencer.setTrackTranspose (transposedTrack, 12);
+        sequencer.prepareToPlay (44100.0, 512);
+
+        beginTest ("tracks merge in time order");
+        HeapBlock<int> notes (numTracks, true), pitches (numTracks, true);
+        int numEvents = 0;
+        const double start = Time::getMillisecondCounterHiRes();
+        while (shuttle.getPositionFrames() < 44100 * 40)
+        {
+            MidiBuffer buffer;
+            sequencer.renderTracks (512, buffer);
+
+            MidiBuffer::Iterator iter (buffer);
+            MidiMessage msg; int pos, lastPos = 0;
+            while (iter.getNextEvent (msg, pos))
+            {
+                expect (pos >= lastPos && pos < 512);
+                lastPos = pos;
+                ++numEvents;
+
+                if (msg.isNoteOn())
+                {
+                    const int track = msg.getChannel() - 1 + 16 * (msg.getVelocity() - 1);
+                    if (isPositiveAndBelow (track, numTracks))
+                    {
+                        ++notes[track];
+                        pitches[track] += msg.getNoteNumber();
+                    }
+                }
+            }
+
+            shuttle.advance (512);
+        }
+
+        logMessage (String (numEvents) + " events from " + String (numTracks) + " tracks in "
+            + String (Time::getMillisecondCounterHiRes() - start, 2) + " ms");
+        expect (numEvents > 0);
+
+        beginTest ("muting and transposing apply per track");
+        expectEquals (notes[mutedTrack], 0);
+        expectEquals (pitches[transposedTrack], expectedPitches[transposedTrack]);
+        for (int track = 0; track < numTracks; ++track)
+        {
+            expectEquals (notes[track], expectedNotes[track]);
+            expectEquals (pitches[track], expectedPitches[track]);
+        }
+
+        beginTest ("tracks can be edited while rendering");
+        {
+            Renderer renderer (sequencer, shuttle);
+            renderer.startThread();
+            while (renderer.numBlocks == 0)
+                Thread::yield();
+
+            for (int i = 0; i < 500; ++i)
+            {
+                const int numTracksNow = sequencer.getNumTracks();
+                if (i % 3 == 0 || numTracksNow == 0)
+                    sequencer.addTrack (makeNotes (i % 16, 50));
+                else if (i % 3 == 1)
+                    sequencer.removeTrack (random.nextInt (numTracksNow));
+                else
+                    sequencer.setTrackSequence (random.nextInt (numTracksNow), makeNotes (i % 16, 20));
+
+                if (i % 100 == 0)
+                    sequencer.compileTracks();
+                Thread::yield();
+            }
+
+            renderer.stopThread (-1);
+            expect (renderer.numBlocks > 0);
+        }
+
+        beginTest ("removed tracks release their notes");
+        {
+            sequencer.clearTracks();
+            shuttle.setPlaying (false);
+            shuttle.processCommands();
+            MidiBuffer released, after;
+            sequencer.renderTracks (512, released);
+            sequencer.renderTracks (512, after);
+            expect (after.isEmpty());
+        }
+    }
+
+private:
+    struct Renderer : public Thread
+    {
+        Renderer (MidiSequencer& s, Shuttle& t) : Thread ("renderer"), sequencer (s), shuttle (t) { }
+
+        void run() override
+        {
+            while (! threadShouldExit())
+            {
+                MidiBuffer buffer;
+                sequencer.renderTracks (512, buffer);
+                shuttle.advance (512);
+                ++numBlocks;
+                Thread::yield();
+            }
+        }
+
+        MidiSequencer& sequencer;
+        Shuttle& shuttle;
+        std::atomic<int> numBlocks { 0 };
+    };
+
+    static MidiMessageSequence makeNotes (int channel, int numNotes)
+    {
+        MidiMessageSequence seq;
+        for (int i = 0; i < numNotes; ++i)
+        {
+            seq.addEvent (MidiMessage::noteOn (1 + channel, 36 + i % 60, (uint8) 100), (double) (i * Shuttle::PPQ));
+            seq.addEvent (MidiMessage::noteOff (1 + channel, 36 + i % 60), (double) (i * Shuttle::PPQ + Shuttle::PPQ / 2));
+        }
+        return seq;
+    }
+};
+
+static MidiSequencerTest sMidiSequencerTest;
+
+class MidiRecordTest : public UnitTest
+{
+public:
+    MidiRecordTest() : UnitTest ("midi-record") { }
+
+    void runTest() override
+    {
+        Shuttle shuttle;
+        MidiSequencePlayer player;
+        player.setShuttle (&shuttle);
+        player.setLooping (false);
+        player.prepareToPlay (44100.0, 256);
+
+        beginTest ("a long take is captured in ticks");
+        shuttle.setPlaying (true);
+        shuttle.setRecording (true);
+        shuttle.processCommands();
+
+        int numSent = 0;
+        for (int block = 0; block < 5000; ++block)
+        {
+            MidiBuffer buffer;
+            if (block % 4 == 0)
+                buffer.addEvent (MidiMessage::noteOn (1, 60, (uint8) 100), 10);
+            else if (block % 4 == 2)
+                buffer.addEvent (MidiMessage::noteOff (1, 60), 10);
+            else
+                continue;
+
+            ++numSent;
+            player.renderSequence (256, buffer);
+            shuttle.advance (256);
+        }
+
+        shuttle.setRecording (false);
+        shuttle.processCommands();
+        player.releaseResources();
+
+        {
+            const ScopedLock sl (player.getSequenceLock());
+            const MidiMessageSequence& seq = player.getSequence();
+            expectEquals (seq.getNumEvents() + player.getNumDroppedEvents(), numSent);
+            expectEquals (player.getNumDroppedEvents(), 0);
+
+            const TimeScale& ts = shuttle.getTimeScale();
+            expectEquals (seq.getEventTime (0), (double) ts.tickFromFrame (10));
+            expect (seq.getEventPointer (0)->noteOffObject != nullptr);
+        }
+
+        beginTest ("recorded input is merged in the background");
+        {
+            MidiSequencePlayer other;
+            other.setShuttle (&shuttle);
+            other.setLooping (false);
+            other.prepareToPlay (44100.0, 256);
+            player.prepareToPlay (44100.0, 256);
+            shuttle.setRecording (true);
+            shuttle.processCommands();
+
+            const int numBefore = getNumEvents (player);
+            MidiBuffer buffer, otherBuffer;
+            buffer.addEvent (MidiMessage::noteOn (1, 64, (uint8) 100), 0);
+            otherBuffer.addEvent (MidiMessage::noteOn (1, 67, (uint8) 100), 0);
+            player.renderSequence (256, buffer);
+            other.renderSequence (256, otherBuffer);
+
+            const uint32 start = Time::getMillisecondCounter();
+            while ((getNumEvents (player) == numBefore || getNumEvents (other) == 0)
+                    && Time::getMillisecondCounter() - start < 2000)
+                Thread::sleep (5);
+
+            expectEquals (getNumEvents (player), numBefore + 1);
+            expectEquals (getNumEvents (other), 1);
+
+            shuttle.setRecording (false);
+            shuttle.processCommands();
+            other.releaseResources();
+            player.releaseResources();
+        }
+    }
+
+private:
+    static int getNumEvents (const MidiSequencePlayer& player)
+    {
+        const ScopedLock sl (player.getSequenceLock());
+        return player.getSequence().getNumEvents();
+    }
+};
+
+static MidiRecordTest sMidiRecordTest;
+
+class ShuttlePositionTest : public UnitTest
+{
+public:
+    ShuttlePositionTest() : UnitTest ("shuttle-position") { }
+    void runTest() override
+    {
+        Shuttle shuttle;
+        shuttle.setTempo (90.f);
+        shuttle.setLengthBeats (16.f);
+        shuttle.setPlaying (true);
+        shuttle.processCommands();
+
+        beginTest ("bar and loop positions");
+        for (int block = 0; block < 2000; ++block)
+        {
+            shuttle.advance (333);
+
+            AudioPlayHead::CurrentPositionInfo pos;
+            expect (shuttle.getCurrentPosition (pos));
+
+            const double beats = (double) pos.timeInSamples * 90.0 / (60.0 * 44100.0);
+            expectWithinAbsoluteError (pos.ppqPosition, beats, 0.0001);
+            expectEquals (pos.ppqPositionOfLastBarStart, std::floor (beats / 4.0) * 4.0);
+            expectWithinAbsoluteError (pos.ppqLoopEnd, 16.0, 0.0001);
+            expect (pos.isPlaying);
+        }
+    }
+};
+
+static ShuttlePositionTest sShuttlePositionTest;
+
+class ShuttleTempoMapTest : public UnitTest
+{
+public:
+    ShuttleTempoMapTest() : UnitTest ("shuttle-tempo-map") { }
+    void runTest() override
+    {
+        TimeScale map;
+        map.setSampleRate (44100);
+        map.setTempo (100.f);
+        map.updateScale();
+        map.addNode (44100 * 4, 140.f, 2, 3);
+        map.addNode (44100 * 9, 75.f, 2, 7);
+
+        Shuttle shuttle;
+        shuttle.setTimeScale (map);
+        shuttle.setLengthBeats (64.f);
+        shuttle.setPlaying (true);
+        shuttle.processCommands();
+
+        TimeScale::Snapshot::Cursor expected (shuttle.getTimeScale().getSnapshot().get());
+
+        beginTest ("positions follow the map");
+        for (int block = 0; block < 3000; ++block)
+        {
+            shuttle.advance (257);
+
+            AudioPlayHead::CurrentPositionInfo pos;
+            shuttle.getCurrentPosition (pos);
+            expectWithinAbsoluteError (pos.ppqPosition,
+                expected.beatPositionAtFrame ((uint64) pos.timeInSamples), 0.000001);
+            expect (pos.ppqPositionOfLastBarStart <= pos.ppqPosition);
+            expect (pos.ppqPosition < pos.ppqPositionOfLastBarStart + pos.timeSigNumerator);
+        }
+
+        AudioPlayHead::CurrentPositionInfo pos;
+        shuttle.getCurrentPosition (pos);
+        expectEquals (pos.timeSigNumerator, 7);
+        expectWithinAbsoluteError (pos.bpm, 75.0, 0.0001);
+
+        beginTest ("tempo changes keep the beat position");
+        const double before = pos.ppqPosition;
+        shuttle.setTempo (133.f);
+        shuttle.processCommands();
+        shuttle.getCurrentPosition (pos);
+        expectWithinAbsoluteError (pos.ppqPosition, before, 0.001);
+        expectWithinAbsoluteError (pos.ppqLoopEnd, 64.0, 0.0001);
+
+        beginTest ("eighth note meters count quarter notes");
+        TimeScale eighths;
+        eighths.setSampleRate (44100);
+        eighths.setTempo (120.f);
+        eighths.setBeatsPerBar (6);
+        eighths.setBeatDivisor (3);
+        eighths.updateScale();
+        eighths.addNode (44100 * 3, 120.f, 2, 4, 2);   // two bars of 6/8, then 4/4
+
+        Shuttle compound;
+        compound.setTimeScale (eighths);
+        compound.setLengthBeats (40.f);                  // 12 eighths and 28 quarters
+        compound.setPlaying (true);
+        compound.processCommands();
+
+        for (int block = 0; block < 3000; ++block)
+        {
+            compound.advance (311);
+            compound.getCurrentPosition (pos);
+
+            const double quarters = (double) pos.timeInSamples * 2.0 / 44100.0;
+            const double barStart = quarters < 6.0 ? std::floor (quarters / 3.0) * 3.0
+                                                   : 6.0 + std::floor ((quarters - 6.0) / 4.0) * 4.0;
+            expectWithinAbsoluteError (pos.ppqPosition, quarters, 0.0001);
+            expectWithinAbsoluteError (pos.ppqPositionOfLastBarStart, barStart, 0.0001);
+            expectWithinAbsoluteError (pos.ppqLoopEnd, 34.0, 0.0001);
+            expectEquals (pos.timeSigDenominator, quarters < 6.0 ? 8 : 4);
+        }
+
+        beginTest ("tempo changes from another thread keep the beat position");
+        Shuttle live;
+        live.setPlaying (true);
+        live.attachAudioThread();
+
+        TempoChanger changer (live);
+        changer.startThread();
+
+        double last = 0.0;
+        const double maxStep = 256.0 * 150.0 / (60.0 * 44100.0);
+        for (int block = 0; block < 20000; ++block)
+        {
+            live.advance (256);
+            live.getCurrentPosition (pos);
+            expect (pos.ppqPosition >= last - 0.0001 && pos.ppqPosition <= last + maxStep + 0.0001,
+                    "jumped from " + String (last) + " to " + String (pos.ppqPosition));
+            last = pos.ppqPosition;
+        }
+
+        changer.stopThread (-1);
+        live.detachAudioThread();
+        expect (changer.numChanges > 0);
+    }
+
+private:
+    struct TempoChanger : public Thread
+    {
+        TempoChanger (Shuttle& s) : Thread ("tempo changer"), shuttle (s) { }
+
+        void run() override
+        {
+            // change again once the audio thread has caught up, so the
+            // queue never fills
+            while (! threadShouldExit())
+            {
+                const float tempo = numChanges % 2 == 0 ? 150.f : 100.f;
+                shuttle.setTempo (tempo);
+                ++numChanges;
+
+                while (shuttle.getTempo() != tempo && ! threadShouldExit())
+                    Thread::yield();
+            }
+        }
+
+        Shuttle& shuttle;
+        std::atomic<int> numChanges { 0 };
+    };
+};
+
+static ShuttleTempoMapTest sShuttleTempoMapTest;
+
+class ShuttleThreadTest : public UnitTest
+{
+public:
+    ShuttleThreadTest() : UnitTest ("shuttle-threads") { }
+    void runTest() override
+    {
+        beginTest ("setters apply straight away without an audio thread");
+        {
+            Shuttle shuttle;
+            shuttle.setPlaying (true);
+            expect (shuttle.isPlaying());
+
+            // more than fit in the command queue
+            for (int i = 1; i <= 1000; ++i)
+                shuttle.seekAudioFrame (i * 10);
+            expectEquals (shuttle.getPositionFrames(), (int64) 10000);
+
+            shuttle.setLengthBeats (8.f);
+            expectEquals (shuttle.getLengthFrames(), (int64) 44100 * 4);
+        }
+
+        beginTest ("an attached audio thread applies setters between blocks");
+        {
+            Shuttle shuttle;
+            shuttle.attachAudioThread();
+            shuttle.setPlaying (true);
+            shuttle.seekAudioFrame (1000);
+            expect (! shuttle.isPlaying());
+            expectEquals (shuttle.getPositionFrames(), (int64) 0);
+
+            shuttle.advance (256);
+            expect (shuttle.isPlaying());
+            expectEquals (shuttle.getPositionFrames(), (int64) 1000);
+
+            shuttle.setRecording (true);
+            shuttle.detachAudioThread();
+            expect (shuttle.isRecording());
+        }
+
+        beginTest ("a gui thread sees every setter and never a torn state");
+        {
+            Shuttle shuttle;
+            shuttle.attachAudioThread();
+            AudioThread audio (shuttle);
+            audio.startThread();
+
+            Random random (7);
+            for (int i = 0; i < 500; ++i)
+            {
+                const bool play      = i % 2 == 0;
+                const float tempo    = 60.f + (float) random.nextInt (120);
+                const float length   = (float) (4 + random.nextInt (64));
+                shuttle.setPlaying (play);
+                shuttle.setTempo (tempo);
+                shuttle.setLengthBeats (length);
+
+                for (;;)
+                {
+                    const Shuttle::State state (shuttle.getState());
+                    expectEquals (state.position.timeInSamples, state.framePos);
+                    expect (state.position.isPlaying == state.playing);
+                    expectEquals ((float) state.position.bpm, state.tempo);
+                    expectWithinAbsoluteError (state.framesPerBeat,
+                                               state.sampleRate * 60.0 / (double) state.tempo, 0.0001);
+
+                    if (state.playing == play && state.tempo == tempo
+                         && std::abs (state.lengthBeats - (double) length) < 0.0001)
+                        break;
+                    Thread::yield();
+                }
+            }
+
+            audio.stopThread (-1);
+            shuttle.detachAudioThread();
+            expect (audio.numBlocks > 0);
+        }
+    }
+
+private:
+    struct AudioThread : public Thread
+    {
+        AudioThread (Shuttle& s) : Thread ("audio"), shuttle (s) { }
+
+        void run() override
+        {
+            while (! threadShouldExit())
+            {
+                shuttle.advance (256);
+                ++numBlocks;
+                Thread::yield();
+            }
+        }
+
+        Shuttle& shuttle;
+        std::atomic<int> numBlocks { 0 };
+    };
+};
+
+static ShuttleThreadTest sShuttleThreadTest;
+
+class ClockSyncTest : public UnitTest
+{
+public:
+    ClockSyncTest() : UnitTest ("clock-sync") { }
+    void runTest() override
+    {
+        testJitteryMidiClock();
+        testSourcePreference();
+    }
+
+private:
+    static MidiMessage stamped (const MidiMessage& message, double seconds)
+    {
+        MidiMessage result (message);
+        result.setTimeStamp (seconds);
+        return result;
+    }
+
+    void testJitteryMidiClock()
+    {
+        beginTest ("jittery midi clock");
+
+        // a remote at 120.12 bpm, each tick up to 2 ms off, against 120 bpm here
+        const double sampleRate = 44100.0, ratio = 1.001;
+        const double tickSeconds = 60.0 / (120.0 * ratio) / 24.0;
+        const double startSeconds = 0.1;
+        Random random (1234);
+
+        ClockSync sync;
+        sync.setSampleRate (sampleRate);
+        sync.setBandwidth (0.25);
+        sync.setMidiClockFramesPerBeat (sampleRate * 0.5);
+        sync.handleMidiMessage (stamped (MidiMessage::midiStart(), startSeconds));
+
+        int numTicks = 0, numBlocks = 0, numErrors = 0;
+        double blockSeconds = 0.0, errorSquared = 0.0;
+
+        while (blockSeconds < 30.0)
+        {
+            const double tick = startSeconds + numTicks * tickSeconds;
+            if (tick < blockSeconds)
+            {
+                const double jitter = (random.nextDouble() * 2.0 - 1.0) * 0.002;
+                sync.handleMidiMessage (stamped (MidiMessage::midiClock(), tick + jitter));
+                ++numTicks;
+                continue;
+            }
+
+            sync.audioBlock (blockSeconds + (random.nextDouble() - 0.5) * 0.0004, 512);
+
+            double position, rate;
+            if (blockSeconds > 8.0 && sync.getPosition ((double) sync.getBlockFrame(), position, rate))
+            {
+                const double error = position - (blockSeconds - startSeconds) * sampleRate * ratio;
+                errorSquared += error * error;
+                ++numErrors;
+            }
+
+            blockSeconds = (double) (++numBlocks * 512) / sampleRate;
+        }
+
+        const ClockSync::Report report (sync.getReport());
+        expectEquals (report.source, (int) ClockSync::MidiClock);
+        expect (report.state == ClockSync::Locked);
+        expectEquals (report.numOutliers, (int64) 0);
+        expectWithinAbsoluteError (report.ratio, ratio, 0.0005);
+
+        // 2 ms uniform is about 51 frames RMS on the way in
+        expect (report.jitter > 30.0 && report.jitter < 80.0);
+        expect (numErrors > 0 && std::sqrt (errorSquared / numErrors) < 20.0);
+    }
+
+    void testSourcePreference()
+    {
+        beginTest ("source preference");
+
+        ClockSync sync;
+        const double block = 512.0;
+
+        int i = 0;
+        for (; i < 2000; ++i)
+        {
+            const double frame = i * block;
+            sync.addTimestamp (ClockSync::JackTransport, frame, 1000.0 + frame);
+            sync.addTimestamp (ClockSync::MidiClock, frame + (i == 1500 ? 300.0 : 0.0), 5000.0 + frame * 1.01);
+        }
+
+        double position, rate;
+        expect (sync.getPosition ((i - 1) * block, position, rate));
+        expectWithinAbsoluteError (position, 1000.0 + (i - 1) * block, 0.01);
+        expectEquals (sync.getReport().source, (int) ClockSync::JackTransport);
+        expectEquals (sync.getReport (ClockSync::MidiClock).numOutliers, (int64) 1);
+
+        beginTest ("fall back when a source stops");
+        for (; i < 2100; ++i)
+            sync.addTimestamp (ClockSync::MidiClock, i * block, 5000.0 + i * block * 1.01);
+
+        expect (sync.getPosition ((i - 1) * block, position, rate));
+        expectWithinAbsoluteError (position, 5000.0 + (i - 1) * block * 1.01, 0.01);
+        expectWithinAbsoluteError (rate, 1.01, 0.0001);
+        expectEquals (sync.getReport().source, (int) ClockSync::MidiClock);
+
+        beginTest ("remote jumps unlock");
+        sync.addTimestamp (ClockSync::MidiClock, i * block, 0.0);
+        expect (sync.getReport (ClockSync::MidiClock).state == ClockSync::Unlocked);
+    }
+};
+
+static ClockSyncTest sClockSyncTest;
+
+class DummyAudioDeviceTest : public UnitTest
+{
+public:
+    DummyAudioDeviceTest() : UnitTest ("dummy-audio-device") { }
+    void runTest() override
+    {
+        DummyAudioDevice::Options options;
+        options.maxJitter = 0.001;
+        options.seed = 99;
+        std::unique_ptr<AudioIODeviceType> type (DummyAudioDevice::createAudioIODeviceType (options));
+
+        const StringArray names (type->getDeviceNames (false));
+        expectEquals (names.size(), 2);
+
+        beginTest ("realtime callbacks");
+        {
+            Counter counter;
+            DummyAudioDevice::Report report;
+            const double seconds = run (*type, names[0], counter, report);
+            const double expected = seconds * 48000.0;
+            expectEquals (counter.blockSize.get(), 256);
+            expect (counter.numSamples.get() > expected * 0.5 && counter.numSamples.get() < expected * 1.5);
+
+            // each callback waited out the jitter it drew, the same
+            // sequence replayed here
+            Random random (options.seed);
+            double maxJitter = 0.0;
+            for (int64 i = 0; i < report.numCallbacks; ++i)
+            {
+                maxJitter = jmax (maxJitter, options.maxJitter * random.nextDouble());
+                random.nextDouble();
+            }
+
+            expect (maxJitter > 0.0);
+            expect (report.maxLateness >= maxJitter);
+        }
+
+        beginTest ("offline callbacks");
+        {
+            Counter counter;
+            DummyAudioDevice::Report report;
+            const double seconds = run (*type, names[1], counter, report);
+            expect (counter.numSamples.get() > seconds * 48000.0 * 2.0);
+            expectEquals (report.maxLateness, 0.0);
+            expectEquals (report.numXRuns, 0);
+        }
+
+        beginTest ("simulated xruns follow the seed");
+        {
+            DummyAudioDevice::Options xrunOptions;
+            xrunOptions.xrunProbability = 0.1;
+            xrunOptions.seed = 1234;
+            std::unique_ptr<AudioIODeviceType> xrunType (DummyAudioDevice::createAudioIODeviceType (xrunOptions));
+
+            Counter counter;
+            DummyAudioDevice::Report report;
+            run (*xrunType, names[1], counter, report);
+
+            // offline, the device draws once per callback and never
+            // overruns for real
+            Random random (xrunOptions.seed);
+            int expected = 0;
+            for (int64 i = 0; i < report.numCallbacks; ++i)
+                if (random.nextDouble() < xrunOptions.xrunProbability)
+                    ++expected;
+
+            expect (expected > 0);
+            expectEquals (report.numSimulatedXRuns, expected);
+            expectEquals (report.numXRuns, expected);
+        }
+    }
+
+private:
+    struct Counter : public AudioIODeviceCallback
+    {
+        Atomic<int64> numSamples;
+        Atomic<int> blockSize;
+        Atomic<int> numStarts, numStops;
+
+        void audioDeviceIOCallback (const float** inputs, int numInputs,
+                                    float** outputs, int numOutputs, int numSamples) override
+        {
+            for (int c = 0; c < numOutputs; ++c)
+                FloatVectorOperations::copy (outputs[c], inputs[c % numInputs], numSamples);
+            this->numSamples += numSamples;
+            blockSize = numSamples;
+        }
+
+        void audioDeviceAboutToStart (AudioIODevice*) override { ++numStarts; }
+        void audioDeviceStopped() override { ++numStops; }
+    };
+
+    double run (AudioIODeviceType& type, const String& name, Counter& counter,
+                DummyAudioDevice::Report& report)
+    {
+        std::unique_ptr<AudioIODevice> device (type.createDevice (name, String()));
+        expect (device != nullptr);
+
+        BigInteger channels;
+        channels.setRange (0, 2, true);
+        expect (device->open (channels, channels, 48000.0, 256).isEmpty());
+
+        const double started = Time::getMillisecondCounterHiRes();
+        device->start (&counter);
+        Thread::sleep (200);
+        device->stop();
+        const double seconds = (Time::getMillisecondCounterHiRes() - started) * 0.001;
+
+        static_cast<DummyAudioDevice*> (device.get())->getReport (report);
+        expectEquals (report.numSamples, counter.numSamples.get());
+        expectEquals (device->getXRunCount(), report.numXRuns);
+        expect (report.maxCallbackTime >= report.meanCallbackTime);
+        expectEquals (counter.numStarts.get(), 1);
+        expectEquals (counter.numStops.get(), 1);
+        return seconds;
+    }
+};
+
+static DummyAudioDeviceTest sDummyAudioDeviceTest;
+
+class AudioCallbackHandoffTest : public UnitTest
+{
+public:
+    AudioCallbackHandoffTest() : UnitTest ("audio-callback-handoff") { }
+    void runTest() override
+    {
+        AudioCallbackHandoff handoff;
+        AudioBuffer<float> buffer (2, 64);
+        AudioIODeviceCallback* old = nullptr;
+
+        beginTest ("outputs are cleared without a callback");
+        for (int c = 0; c < buffer.getNumChannels(); ++c)
+            FloatVectorOperations::fill (buffer.getWritePointer (c), 1.f, buffer.getNumSamples());
+        process (handoff, buffer);
+        expectEquals (buffer.getMagnitude (0, buffer.getNumSamples()), 0.f);
+
+        beginTest ("swapping waits for the cycle running the old callback");
+        Blocker first, second;
+        expect (handoff.swap (&first, old, 1000));
+        expect (old == nullptr);
+        {
+            Cycle cycle (handoff, buffer);
+            cycle.startThread();
+            first.entered.wait();
+
+            Swapper swapper (handoff, &second);
+            swapper.startThread();
+            Thread::sleep (50);
+            expect (! swapper.finished);
+
+            first.release.signal();
+            swapper.waitForThreadToExit (-1);
+            cycle.waitForThreadToExit (-1);
+            expect (swapper.released);
+            expect (swapper.oldCallback == &first);
+        }
+
+        beginTest ("a stuck cycle times out");
+        {
+            Cycle cycle (handoff, buffer);
+            cycle.startThread();
+            second.entered.wait();
+
+            expect (! handoff.swap (nullptr, old, 50));
+            expect (old == &second);
+
+            second.release.signal();
+            cycle.waitForThreadToExit (-1);
+        }
+
+        beginTest ("released callbacks are never run again");
+        {
+            Checker checkers [2];
+            AudioThread audio (handoff, buffer);
+            audio.startThread();
+            while (audio.numCycles == 0)
+                Thread::yield();
+
+            for (int i = 0; i < 2000; ++i)
+            {
+                Checker& next = checkers [i % 2];
+                next.stopped = false;
+                expect (handoff.swap (&next, old, 1000));
+                if (old != nullptr)
+                    static_cast<Checker*> (old)->stopped = true;
+                Thread::yield();
+            }
+
+            expect (handoff.swap (nullptr, old, 1000));
+            audio.stopThread (-1);
+
+            expectEquals (checkers[0].numLateCalls.load() + checkers[1].numLateCalls.load(), 0);
+        }
+    }
+
+private:
+    static void process (AudioCallbackHandoff& handoff, AudioBuffer<float>& buffer)
+    {
+        handoff.process (buffer.getArrayOfReadPointers(), buffer.getNumChannels(),
+                         buffer.getArrayOfWritePointers(), buffer.getNumChannels(),
+                         buffer.getNumSamples());
+    }
+
+    /** Holds the audio thread inside its callback until released */
+    struct Blocker : public AudioIODeviceCallback
+    {
+        WaitableEvent entered, release;
+
+        void audioDeviceIOCallback (const float**, int, float**, int, int) override
+        {
+            entered.signal();
+            release.wait();
+        }
+
+        void audioDeviceAboutToStart (AudioIODevice*) override { }
+        void audioDeviceStopped() override { }
+    };
+
+    /** Counts calls made after the handoff said it was done with it */
+    struct Checker : public AudioIODeviceCallback
+    {
+        std::atomic<bool> stopped { true };
+        std::atomic<int> numLateCalls { 0 };
+
+        void audioDeviceIOCallback (const float**, int, float**, int, int) override
+        {
+            // yield mid cycle, giving a swap the chance to overtake it
+            const bool lateOnEntry = stopped;
+            Thread::yield();
+            if (lateOnEntry || stopped)
+                ++numLateCalls;
+        }
+
+        void audioDeviceAboutToStart (AudioIODevice*) override { }
+        void audioDeviceStopped() override { }
+    };
+
+    struct Cycle : public Thread
+    {
+        Cycle (AudioCallbackHandoff& h, AudioBuffer<float>& b)
+            : Thread ("cycle"), handoff (h), buffer (b) { }
+
+        void run() override { process (handoff, buffer); }
+
+        AudioCallbackHandoff& handoff;
+        AudioBuffer<float>& buffer;
+    };
+
+    struct AudioThread : public Thread
+    {
+        AudioThread (AudioCallbackHandoff& h, AudioBuffer<float>& b)
+            : Thread ("audio"), handoff (h), buffer (b) { }
+
+        void run() override
+        {
+            while (! threadShouldExit())
+            {
+                process (handoff, buffer);
+                ++numCycles;
+            }
+        }
+
+        AudioCallbackHandoff& handoff;
+        AudioBuffer<float>& buffer;
+        std::atomic<int> numCycles { 0 };
+    };
+
+    struct Swapper : public Thread
+    {
+        Swapper (AudioCallbackHandoff& h, AudioIODeviceCallback* cb)
+            : Thread ("swapper"), handoff (h), newCallback (cb) { }
+
+        void run() override
+        {
+            released = handoff.swap (newCallback, oldCallback, 5000);
+            finished = true;
+        }
+
+        AudioCallbackHandoff& handoff;
+        AudioIODeviceCallback* newCallback;
+        AudioIODeviceCallback* oldCallback = nullptr;
+        std::atomic<bool> released { false }, finished { false };
+    };
+};
+
+static AudioCallbackHandoffTest sAudioCallbackHandoffTest;
+
+class OfflineRendererTest : public UnitTest
+{
+public:
+    OfflineRendererTest() : UnitTest ("offline-renderer") { }
+    void runTest() override
+    {
+        WavAudioFormat wav;
+        OwnedArray<RampProcessor> processors;
+        OwnedArray<OfflineRenderer::Job> jobs;
+        OwnedArray<MemoryBlock> files;
+
+        for (int i = 0; i < 6; ++i)
+        {
+            auto* file = files.add (new MemoryBlock());
+            auto* job  = jobs.add (new OfflineRenderer::Job());
+            job->processor  = processors.add (new RampProcessor());
+            job->numSamples = 100000 + i * 1234;
+            job->blockSize  = 333;
+            job->writer.reset (wav.createWriterFor (new MemoryOutputStream (*file, false),
+                                                    48000.0, 2, 32, {}, 0));
+        }
+
+        Shuttle shuttle;
+        shuttle.seekAudioFrame (12345);
+        jobs.getFirst()->shuttle = &shuttle;
+
+        beginTest ("render in parallel");
+        OfflineRenderer renderer (3);
+        expectEquals (renderer.renderAll (jobs), jobs.size());
+        expectEquals (shuttle.getPositionFrames(), jobs.getFirst()->numSamples);
+        expect (shuttle.isPlaying());
+
+        for (int i = 0; i < jobs.size(); ++i)
+        {
+            expect (jobs[i]->completed);
+            expect (jobs[i]->writer == nullptr);
+
+            std::unique_ptr<AudioFormatReader> reader (wav.createReaderFor (
+                new MemoryInputStream (*files[i], false), true));
+            expect (reader != nullptr);
+            if (reader == nullptr)
+                continue;
+
+            expectEquals (reader->lengthInSamples, jobs[i]->numSamples);
+
+            AudioBuffer<float> audio (2, (int) reader->lengthInSamples);
+            reader->read (&audio, 0, audio.getNumSamples(), 0, true, true);
+
+            bool matches = true;
+            for (int s = 0; s < audio.getNumSamples(); ++s)
+                matches &= audio.getSample (0, s) == RampProcessor::valueAt (s)
+                        && audio.getSample (1, s) == -RampProcessor::valueAt (s);
+            expect (matches);
+        }
+
+        beginTest ("a cancel only stops the renders it interrupts");
+        {
+            renderer.cancel();
+            MemoryBlock file;
+            OwnedArray<OfflineRenderer::Job> again;
+            auto* job = again.add (new OfflineRenderer::Job());
+            job->processor  = processors.getFirst();
+            job->numSamples = 1000;
+            job->writer.reset (wav.createWriterFor (new MemoryOutputStream (file, false),
+                                                    48000.0, 2, 32, {}, 0));
+            expectEquals (renderer.renderAll (again), 1);
+        }
+
+        beginTest ("missing writer");
+        OfflineRenderer::Job empty;
+        empty.processor = processors.getFirst();
+        expect (! renderer.render (empty));
+        expect (empty.error.isNotEmpty());
+    }
+
+private:
+    class RampProcessor : public AudioProcessor
+    {
+    public:
+        RampProcessor() : AudioProcessor (BusesProperties().withOutput ("Output", AudioChannelSet::stereo())) { }
+
+        static float valueAt (int64 frame) { return (float) (frame % 1000) / 1000.0f; }
+
+        const String getName() const override { return "Ramp"; }
+        void prepareToPlay (double, int) override { position = 0; }
+        void releaseResources() override { }
+
+        void processBlock (AudioBuffer<float>& buffer, MidiBuffer&) override
+        {
+            for (int s = 0; s < buffer.getNumSamples(); ++s)
+            {
+                buffer.setSample (0, s, valueAt (position + s));
+                buffer.setSample (1, s, -valueAt (position + s));
+            }
+
+            position += buffer.getNumSamples();
+        }
+
+        double getTailLengthSeconds() const override { return 0.0; }
+        bool acceptsMidi() const override { return false; }
+        bool producesMidi() const override { return false; }
+        AudioProcessorEditor* createEditor() override { return nullptr; }
+        bool hasEditor() const override { return false; }
+        int getNumPrograms() override { return 1; }
+        int getCurrentProgram() override { return 0; }
+        void setCurrentProgram (int) override { }
+        const String getProgramName (int) override { return {}; }
+        void changeProgramName (int, const String&) override { }
+        void getStateInformation (MemoryBlock&) override { }
+        void setStateInformation (const void*, int) override { }
+
+    private:
+        int64 position = 0;
+    };
+};
+
+static OfflineRendererTest sOfflineRendererTest;
+
+#if KV_TIMESCALE_HIGH_PRECISION
+class TimeScalePrecisionTest : public UnitTest
+{
+public:
+    TimeScalePrecisionTest() : UnitTest ("timescale-precision") { }
+    void runTest() override
+    {
+        const int sampleRates[] = { 44100, 48000, 96000, 192000 };
+        Random random (4321);
+
+        for (const int sampleRate : sampleRates)
+        {
+            TimeScale ts;
+            ts.setSampleRate ((unsigned int) sampleRate);
+            ts.setTempo (97.3f);
+            ts.updateScale();
+
+            const uint64 day = (uint64) sampleRate * 86400;
+            for (int i = 1; i < 6; ++i)
+                ts.addNode (day / 6 * (uint64) i, 60.f + 23.7f * (float) i);
+
+            const uint64 lastTick = ts.tickFromFrame (day);
+
+            // frames are finer than ticks, so frame to tick to frame is only
+            // good to half a tick (at 60 bpm at worst), but must not drift
+            const double maxError = 0.5 * sampleRate / ts.ticksPerBeat() + 1.0;
+
+            beginTest ("24 hours at " + String (sampleRate));
+            for (int i = 0; i < 100000; ++i)
+            {
+                const uint64 tick = (uint64) random.nextInt64() % lastTick;
+                expectEquals ((int64) ts.tickFromFrame (ts.frameFromTick (tick)), (int64) tick);
+
+                const uint64 frame = (uint64) random.nextInt64() % day;
+                const double error = std::abs ((double) ts.frameFromTick (ts.tickFromFrame (frame)) - (double) frame);
+                expect (error <= maxError);
+            }
+        }
+    }
+};
+
+static TimeScalePrecisionTest sTimeScalePrecisionTest;
+#endif
+
 }
 
 int main (int argc, char* argv[])
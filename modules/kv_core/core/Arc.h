@@ -93,7 +93,38 @@ public:
     bool isAnInputTo (const uint32 possibleInputId,
                       const uint32 possibleDestinationId) const noexcept
     {
-        return isAnInputToRecursive (possibleInputId, possibleDestinationId, entries.size());
+        // each node is only searched once, so diamond shaped graphs don't
+        // blow up. For repeated queries on large graphs, see ArcTopology
+        SortedSet<uint32> visited;
+        Array<uint32> pending;
+        pending.add (possibleDestinationId);
+
+        while (pending.size() > 0)
+        {
+            const uint32 nodeId = pending.getLast();
+            pending.removeLast();
+
+            int index;
+            if (const Entry* const entry = findEntry (nodeId, index))
+            {
+                const SortedSet<uint32>& srcNodes = entry->srcNodes;
+
+                if (srcNodes.contains (possibleInputId))
+                    return true;
+
+                for (int i = 0; i < srcNodes.size(); ++i)
+                {
+                    const uint32 srcNode = srcNodes.getUnchecked (i);
+                    if (! visited.contains (srcNode))
+                    {
+                        visited.add (srcNode);
+                        pending.add (srcNode);
+                    }
+                }
+            }
+        }
+
+        return false;
     }
 
 private:
@@ -109,30 +140,6 @@ private:
 
     OwnedArray<Entry> entries;
 
-    bool isAnInputToRecursive (const uint32 possibleInputId,
-                               const uint32 possibleDestinationId,
-                               int recursionCheck) const noexcept
-    {
-        int index;
-
-        if (const Entry* const entry = findEntry (possibleDestinationId, index))
-        {
-            const SortedSet<uint32>& srcNodes = entry->srcNodes;
-
-            if (srcNodes.contains (possibleInputId))
-                return true;
-
-            if (--recursionCheck >= 0)
-            {
-                for (int i = 0; i < srcNodes.size(); ++i)
-                    if (isAnInputToRecursive (possibleInputId, srcNodes.getUnchecked(i), recursionCheck))
-                        return true;
-            }
-        }
-
-        return false;
-    }
-
     Entry* findEntry (const uint32 destNode, int& insertIndex) const noexcept
     {
         Entry* result = nullptr;
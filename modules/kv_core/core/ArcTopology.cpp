@@ -0,0 +1,320 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+namespace ArcTopologyHelpers
+{
+    template<class NodeArray>
+    struct PositionSorter
+    {
+        PositionSorter (const NodeArray& n) : nodes (n) { }
+        int compareElements (int a, int b) const noexcept
+        {
+            return nodes.getReference(a).position - nodes.getReference(b).position;
+        }
+
+        const NodeArray& nodes;
+    };
+
+    struct IntSorter
+    {
+        static int compareElements (int a, int b) noexcept { return a - b; }
+    };
+}
+
+void ArcTopology::clear()
+{
+    nodes.clear();
+    indexes.clear();
+    order.clear();
+    freeNodes.clear();
+    numNodes = 0;
+}
+
+int ArcTopology::indexOf (uint32 nodeId) const
+{
+    return indexes.contains (nodeId) ? indexes [nodeId] : -1;
+}
+
+int ArcTopology::getOrCreateNode (uint32 nodeId)
+{
+    const int existing = indexOf (nodeId);
+    if (existing >= 0)
+        return existing;
+
+    int index;
+    if (freeNodes.size() > 0)
+    {
+        index = freeNodes.getLast();
+        freeNodes.removeLast();
+    }
+    else
+    {
+        index = nodes.size();
+        nodes.add (Node());
+    }
+
+    // a node without arcs can go anywhere, so put it at the end
+    Node& node      = nodes.getReference (index);
+    node.nodeId     = nodeId;
+    node.position   = order.size();
+    node.visited    = 0;
+    node.outputs.clearQuick();
+    node.inputs.clearQuick();
+
+    order.add (index);
+    indexes.set (nodeId, index);
+    ++numNodes;
+    return index;
+}
+
+void ArcTopology::addNode (uint32 nodeId)
+{
+    getOrCreateNode (nodeId);
+}
+
+void ArcTopology::removeNode (uint32 nodeId)
+{
+    const int index = indexOf (nodeId);
+    if (index < 0)
+        return;
+
+    Node& node = nodes.getReference (index);
+    for (const int output : node.outputs)
+        nodes.getReference(output).inputs.removeFirstMatchingValue (index);
+    for (const int input : node.inputs)
+        nodes.getReference(input).outputs.removeFirstMatchingValue (index);
+
+    node.outputs.clear();
+    node.inputs.clear();
+    order.set (node.position, -1);
+    node.position = -1;
+
+    indexes.remove (nodeId);
+    freeNodes.add (index);
+    --numNodes;
+
+    if (order.size() > 32 && numNodes < order.size() / 2)
+        compact();
+}
+
+bool ArcTopology::wouldCreateCycle (uint32 sourceNode, uint32 destNode) const
+{
+    if (sourceNode == destNode)
+        return true;
+
+    const int source = indexOf (sourceNode);
+    const int dest   = indexOf (destNode);
+    if (source < 0 || dest < 0)
+        return false;
+
+    const int upperBound = nodes.getReference(source).position;
+    if (upperBound < nodes.getReference(dest).position)
+        return false;
+
+    return searchForward (dest, upperBound, source, nullptr);
+}
+
+bool ArcTopology::addArc (uint32 sourceNode, uint32 destNode)
+{
+    if (sourceNode == destNode)
+        return false;
+
+    // a node without arcs can't close a cycle, so only an arc between two
+    // existing nodes can be rejected. Check those before creating anything
+    Array<int> forward, backward;
+    const int knownSource = indexOf (sourceNode);
+    const int knownDest   = indexOf (destNode);
+    if (knownSource >= 0 && knownDest >= 0)
+    {
+        const int upperBound = nodes.getReference(knownSource).position;
+        if (upperBound > nodes.getReference(knownDest).position
+             && searchForward (knownDest, upperBound, knownSource, &forward))
+            return false;
+    }
+
+    const int source = getOrCreateNode (sourceNode);
+    const int dest   = getOrCreateNode (destNode);
+
+    const int lowerBound = nodes.getReference(dest).position;
+    const int upperBound = nodes.getReference(source).position;
+
+    if (upperBound > lowerBound)
+    {
+        if (forward.isEmpty())
+            searchForward (dest, upperBound, source, &forward);
+
+        searchBackward (source, lowerBound, backward);
+        reorder (forward, backward);
+    }
+
+    nodes.getReference(source).outputs.add (dest);
+    nodes.getReference(dest).inputs.add (source);
+    return true;
+}
+
+void ArcTopology::removeArc (uint32 sourceNode, uint32 destNode)
+{
+    const int source = indexOf (sourceNode);
+    const int dest   = indexOf (destNode);
+    if (source < 0 || dest < 0)
+        return;
+
+    nodes.getReference(source).outputs.removeFirstMatchingValue (dest);
+    nodes.getReference(dest).inputs.removeFirstMatchingValue (source);
+}
+
+bool ArcTopology::isAnInputTo (uint32 possibleInputId, uint32 possibleDestinationId) const
+{
+    if (possibleInputId == possibleDestinationId)
+        return false;
+
+    const int input = indexOf (possibleInputId);
+    const int dest  = indexOf (possibleDestinationId);
+    if (input < 0 || dest < 0)
+        return false;
+
+    const int upperBound = nodes.getReference(dest).position;
+    if (nodes.getReference(input).position >= upperBound)
+        return false;
+
+    return searchForward (input, upperBound, dest, nullptr);
+}
+
+void ArcTopology::getProcessingOrder (Array<uint32>& result) const
+{
+    result.clearQuick();
+    result.ensureStorageAllocated (numNodes);
+    for (const int index : order)
+        if (index >= 0)
+            result.add (nodes.getReference(index).nodeId);
+}
+
+uint32 ArcTopology::nextVisitMark() const
+{
+    if (++visitMark == 0)
+    {
+        for (const auto& node : nodes)
+            node.visited = 0;
+        visitMark = 1;
+    }
+
+    return visitMark;
+}
+
+bool ArcTopology::searchForward (int start, int upperBound, int target, Array<int>* found) const
+{
+    const uint32 mark = nextVisitMark();
+    stack.clearQuick();
+    stack.add (start);
+    nodes.getReference(start).visited = mark;
+
+    while (stack.size() > 0)
+    {
+        const int index = stack.getLast();
+        stack.removeLast();
+        if (found != nullptr)
+            found->add (index);
+
+        for (const int output : nodes.getReference(index).outputs)
+        {
+            if (output == target)
+                return true;
+
+            const Node& next = nodes.getReference (output);
+            if (next.visited != mark && next.position < upperBound)
+            {
+                next.visited = mark;
+                stack.add (output);
+            }
+        }
+    }
+
+    return false;
+}
+
+void ArcTopology::searchBackward (int start, int lowerBound, Array<int>& found) const
+{
+    const uint32 mark = nextVisitMark();
+    stack.clearQuick();
+    stack.add (start);
+    nodes.getReference(start).visited = mark;
+
+    while (stack.size() > 0)
+    {
+        const int index = stack.getLast();
+        stack.removeLast();
+        found.add (index);
+
+        for (const int input : nodes.getReference(index).inputs)
+        {
+            const Node& prev = nodes.getReference (input);
+            if (prev.visited != mark && prev.position > lowerBound)
+            {
+                prev.visited = mark;
+                stack.add (input);
+            }
+        }
+    }
+}
+
+void ArcTopology::reorder (Array<int>& forward, Array<int>& backward)
+{
+    // the nodes reaching the source move ahead of the nodes reached from
+    // the destination, reusing the same set of positions
+    ArcTopologyHelpers::PositionSorter<Array<Node>> sorter (nodes);
+    forward.sort (sorter);
+    backward.sort (sorter);
+
+    Array<int> positions;
+    positions.ensureStorageAllocated (forward.size() + backward.size());
+    for (const int index : backward)
+        positions.add (nodes.getReference(index).position);
+    for (const int index : forward)
+        positions.add (nodes.getReference(index).position);
+    
+    ArcTopologyHelpers::IntSorter intSorter;
+    positions.sort (intSorter);
+
+    int i = 0;
+    for (const int index : backward)
+    {
+        nodes.getReference(index).position = positions [i];
+        order.set (positions [i++], index);
+    }
+    for (const int index : forward)
+    {
+        nodes.getReference(index).position = positions [i];
+        order.set (positions [i++], index);
+    }
+}
+
+void ArcTopology::compact()
+{
+    Array<int> newOrder;
+    newOrder.ensureStorageAllocated (numNodes);
+    for (const int index : order)
+    {
+        if (index < 0)
+            continue;
+        nodes.getReference(index).position = newOrder.size();
+        newOrder.add (index);
+    }
+
+    order.swapWith (newOrder);
+}
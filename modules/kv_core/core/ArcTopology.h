@@ -0,0 +1,115 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#pragma once
+
+/** An incrementally maintained topological order of a graph of arcs.
+
+    Uses the Pearce-Kelly dynamic topological sort: every node keeps a
+    position in the processing order and adding an arc only reorders the
+    nodes between its two endpoints. Because sources always come before
+    their destinations, "would this arc create a cycle" and "is this node
+    an input to that one" usually answer straight from the positions
+    without walking the graph.
+
+    Node IDs match Arc::sourceNode and Arc::destNode. Multiple arcs between
+    the same two nodes (different ports) are counted separately, so the
+    nodes stay connected until the last one is removed.
+    
+    @see Arc, ArcTable
+ */
+class ArcTopology
+{
+public:
+    ArcTopology() { }
+
+    /** Builds the topology from a set of arcs. Arcs which would make a
+        cycle are ignored */
+    template<class ArcType>
+    explicit ArcTopology (const OwnedArray<ArcType>& arcs)
+    {
+        for (const auto* arc : arcs)
+            addArc (arc->sourceNode, arc->destNode);
+    }
+
+    ~ArcTopology() { }
+
+    /** Removes all nodes and arcs */
+    void clear();
+
+    /** Returns the number of nodes */
+    int getNumNodes() const noexcept { return numNodes; }
+
+    /** Returns true if the node is known */
+    bool containsNode (uint32 nodeId) const { return indexOf (nodeId) >= 0; }
+
+    /** Adds a node with no connections. Nodes are also added automatically
+        by addArc */
+    void addNode (uint32 nodeId);
+
+    /** Removes a node and all of its arcs */
+    void removeNode (uint32 nodeId);
+
+    /** Returns true if adding an arc from source to dest would create a
+        cycle. Returns immediately when source is already ordered before dest */
+    bool wouldCreateCycle (uint32 sourceNode, uint32 destNode) const;
+
+    /** Adds an arc, adding its nodes and reordering them if needed.
+        @returns false if the arc would create a cycle. Nothing is added
+                 then, not even the nodes */
+    bool addArc (uint32 sourceNode, uint32 destNode);
+
+    /** Removes one arc between two nodes. Removing arcs never changes the order */
+    void removeArc (uint32 sourceNode, uint32 destNode);
+
+    /** Returns true if there is a path from possibleInputId to
+        possibleDestinationId */
+    bool isAnInputTo (uint32 possibleInputId, uint32 possibleDestinationId) const;
+
+    /** Fills the array with node IDs in processing order: every node comes
+        after all of the nodes feeding it */
+    void getProcessingOrder (Array<uint32>& result) const;
+
+private:
+    struct Node
+    {
+        uint32 nodeId = 0;
+        int position = -1;
+        Array<int> outputs, inputs;
+        mutable uint32 visited = 0;
+    };
+
+    Array<Node> nodes;
+    HashMap<uint32, int> indexes;
+    Array<int> order;           // position -> node index, -1 for a gap
+    Array<int> freeNodes;
+    int numNodes = 0;
+    mutable uint32 visitMark = 0;
+    mutable Array<int> stack;
+
+    int indexOf (uint32 nodeId) const;
+    int getOrCreateNode (uint32 nodeId);
+    uint32 nextVisitMark() const;
+    bool searchForward (int start, int upperBound, int target, Array<int>* found) const;
+    void searchBackward (int start, int lowerBound, Array<int>& found) const;
+    void reorder (Array<int>& forward, Array<int>& backward);
+    void compact();
+    
+    JUCE_LEAK_DETECTOR (ArcTopology)
+};
@@ -21,12 +21,24 @@
 
 #pragma once
 
-/** A doubly linked list */
+/** A doubly linked list
+
+    Scoped lists own the nodes removed from them, and keep them alive until
+    recycle() or clear() so pointers held elsewhere stay valid. Nodes made
+    with create() live in blocks of storage owned by the list and go back to
+    the pool then, so a list which has been reserve()d for the nodes it
+    holds at once, and recycled between edits, never touches the heap.
+
+    An indexed list also keeps its nodes in an implicit treap, ordered by
+    position, which makes at() and find() O(log n) rather than a walk.
+ */
 template <class Node>
 class LinkedList
 {
 public:
-    LinkedList() : firstNode(0), lastNode(0), numNodes(0), freeList(0), scopedList(false) { }
+    LinkedList() : firstNode(0), lastNode(0), numNodes(0), freeList(0), scopedList(false),
+                   freeSlots (nullptr), poolSize (0), fixedCapacity (false),
+                   treeRoot (nullptr), indexed (false), seed (0x9e3779b9) { }
     ~LinkedList() { clear(); }
 
     Node* first() const { return firstNode; }
@@ -48,13 +60,50 @@ public:
     Node *operator[] (int index) const { return at(index); }
     int find (Node *node) const;
 
+    /** Construct a node in pooled storage. The list must be scoped.
+        Returns nullptr if the pool is empty and the capacity is fixed */
+    template <typename... Args>
+    Node* create (Args&&... args);
+
+    /** Grow the pool so it holds at least numNodes nodes. Removed nodes
+        keep their storage until recycle() or clear() */
+    void reserve (int numNodes);
+
+    /** Destroy the removed pooled nodes and return their storage to the
+        pool. Call at a point where nothing can still be pointing at them */
+    void recycle();
+
+    /** Returns the number of nodes the pool can hold */
+    int capacity() const { return poolSize; }
+
+    /** When set, create() will not allocate and fails once the pool is
+        used up. Reserve first, then set this for lists edited on the
+        audio thread. Keep in mind node destructors still run in clear() */
+    void setFixedCapacity (bool fixed) { fixedCapacity = fixed; }
+    bool hasFixedCapacity() const { return fixedCapacity; }
+
+    /** Keep a position index so at() and find() run in O(log n). Each
+        insert and removal then costs O(log n) as well */
+    void setIndexed (bool shouldIndex);
+    bool isIndexed() const { return indexed; }
+
+    /** Returns the last node the predicate holds for, or nullptr. The list
+        must be partitioned, every node it holds for coming before every
+        node it doesn't, as with nodes sorted by a key and a "key <= value"
+        test. O(log n) when indexed */
+    template <class Predicate>
+    Node* findLast (Predicate predicate) const;
+
     /** Base list node */
     class Link
     {
     public:
         Link() : prevNode (nullptr),
                  nextNode (nullptr),
-                 nextFreeNode (nullptr) { }
+                 nextFreeNode (nullptr),
+                 pooledNode (false),
+                 treeParent (nullptr), treeLeft (nullptr), treeRight (nullptr),
+                 treeSize (0), treePriority (0) { }
 
         Node *prev() const { return prevNode; }
         Node *next() const { return nextNode; }
@@ -65,12 +114,21 @@ public:
         Node *nextFree() const { return nextFreeNode; }
         void setNextFree (Node *node) { nextFreeNode = node; }
 
+        /** Returns true if this node lives in a list's pool */
+        bool isPooled() const { return pooledNode; }
+
     private:
+        friend class LinkedList;
         Node *prevNode;
         Node *nextNode;
         Node *nextFreeNode;
+        bool pooledNode;
 
-        JUCE_LEAK_DETECTOR(Link)
+        Node *treeParent;
+        Node *treeLeft;
+        Node *treeRight;
+        int treeSize;
+        uint32 treePriority;
     };
 
     class iterator
@@ -121,6 +179,25 @@ private:
     int numNodes;
     Node *freeList;
     bool scopedList;
+
+    /** Unused pool storage is threaded through its first bytes */
+    struct Slot { Slot* nextSlot; };
+    Slot* freeSlots;
+    OwnedArray<HeapBlock<char> > blocks;
+    int poolSize;
+    bool fixedCapacity;
+
+    void addBlock (int numSlots);
+    void release (Node* node);
+
+    Node* treeRoot;
+    bool indexed;
+    uint32 seed;
+
+    static int sizeOf (const Node* node) { return node != nullptr ? node->treeSize : 0; }
+    void indexInsert (Node* node);
+    void indexRemove (Node* node);
+    void rotateUp (Node* node);
 };
 
 template <class Node> 
@@ -146,6 +223,9 @@ void LinkedList<Node>::insertAfter (Node *node, Node *previous)
     }
 
     ++numNodes;
+
+    if (indexed)
+        indexInsert (node);
 }
 
 template <class Node>
@@ -172,11 +252,17 @@ void LinkedList<Node>::insertBefore (Node *node, Node *next_node)
     }
 
     ++numNodes;
+
+    if (indexed)
+        indexInsert (node);
 }
 
 template <class Node>
 void LinkedList<Node>::unlink (Node *node)
 {
+    if (indexed)
+        indexRemove (node);
+
     if (node->prev())
         (node->prev())->setNext(node->next());
     else
@@ -205,6 +291,29 @@ void LinkedList<Node>::remove (Node *node)
     }
 }
 
+template <class Node>
+void LinkedList<Node>::recycle()
+{
+    // heap nodes stay on the free list until clear()
+    Node *kept = nullptr;
+    for (Node *node = freeList; node;)
+    {
+        Node *nextFree = node->nextFree();
+        if (node->isPooled())
+        {
+            release (node);
+        }
+        else
+        {
+            node->setNextFree (kept);
+            kept = node;
+        }
+        node = nextFree;
+    }
+
+    freeList = kept;
+}
+
 // Reset methods.
 template <class Node>
 void LinkedList<Node>::clear()
@@ -221,7 +330,10 @@ void LinkedList<Node>::clear()
     while (free_list)
     {
         Node *nextFree = free_list->nextFree();
-        delete free_list;
+        if (free_list->isPooled())
+            release (free_list);
+        else
+            delete free_list;
         free_list = nextFree;
     }
 
@@ -229,6 +341,61 @@ void LinkedList<Node>::clear()
     firstNode = lastNode = 0;
     numNodes = 0;
     freeList = 0;
+    treeRoot = nullptr;
+}
+
+template <class Node>
+template <typename... Args>
+Node* LinkedList<Node>::create (Args&&... args)
+{
+    // the list has to own pooled nodes
+    jassert (scopedList);
+
+    if (freeSlots == nullptr)
+    {
+        if (fixedCapacity)
+            return nullptr;
+        addBlock (jmax (16, poolSize));
+    }
+
+    Slot* slot = freeSlots;
+    freeSlots = slot->nextSlot;
+
+    Node* node = new (slot) Node (std::forward<Args> (args)...);
+    node->pooledNode = true;
+    return node;
+}
+
+template <class Node>
+void LinkedList<Node>::reserve (int numNodes)
+{
+    if (numNodes > poolSize)
+        addBlock (numNodes - poolSize);
+}
+
+template <class Node>
+void LinkedList<Node>::addBlock (int numSlots)
+{
+    static_assert (sizeof (Node) >= sizeof (Slot), "node too small for the pool");
+
+    HeapBlock<char>* block = blocks.add (new HeapBlock<char> ((size_t) numSlots * sizeof (Node)));
+    for (int i = numSlots; --i >= 0;)
+    {
+        Slot* slot = reinterpret_cast<Slot*> (block->getData() + (size_t) i * sizeof (Node));
+        slot->nextSlot = freeSlots;
+        freeSlots = slot;
+    }
+
+    poolSize += numSlots;
+}
+
+template <class Node>
+void LinkedList<Node>::release (Node* node)
+{
+    node->~Node();
+    Slot* slot = reinterpret_cast<Slot*> (node);
+    slot->nextSlot = freeSlots;
+    freeSlots = slot;
 }
 
 template <class Node>
@@ -240,6 +407,26 @@ Node* LinkedList<Node>::at (int index) const
     if (index < 0 || index >= numNodes)
       return 0;
 
+    if (indexed)
+    {
+        node = treeRoot;
+        while (node)
+        {
+            const int left = sizeOf (node->treeLeft);
+            if (index < left)
+                node = node->treeLeft;
+            else if (index == left)
+                break;
+            else
+            {
+                index -= left + 1;
+                node = node->treeRight;
+            }
+        }
+
+        return node;
+    }
+
     if (index > (numNodes >> 1))
     {
         for (i = numNodes - 1, node = lastNode; node && i > index; --i, node = node->prev())
@@ -257,6 +444,23 @@ Node* LinkedList<Node>::at (int index) const
 template <class Node>
 int LinkedList<Node>::find (Node *node) const
 {
+    if (indexed)
+    {
+        if (node == nullptr)
+            return -1;
+
+        int position = sizeOf (node->treeLeft);
+        while (Node* parent = node->treeParent)
+        {
+            if (node == parent->treeRight)
+                position += sizeOf (parent->treeLeft) + 1;
+            node = parent;
+        }
+
+        // a node from elsewhere ends at a different root
+        return node == treeRoot ? position : -1;
+    }
+
     int index = 0;
     Node *n = firstNode;
 
@@ -271,3 +475,156 @@ int LinkedList<Node>::find (Node *node) const
 
   return -1;
 }
+
+template <class Node>
+template <class Predicate>
+Node* LinkedList<Node>::findLast (Predicate predicate) const
+{
+    Node *result = nullptr;
+
+    if (indexed)
+    {
+        // nodes left of one which passes pass too, so go right when it
+        // passes and left when it doesn't
+        for (Node *node = treeRoot; node;)
+        {
+            if (predicate (static_cast<const Node&> (*node)))
+            {
+                result = node;
+                node = node->treeRight;
+            }
+            else
+            {
+                node = node->treeLeft;
+            }
+        }
+
+        return result;
+    }
+
+    for (Node *node = firstNode; node && predicate (static_cast<const Node&> (*node)); node = node->next())
+        result = node;
+
+    return result;
+}
+
+template <class Node>
+void LinkedList<Node>::setIndexed (bool shouldIndex)
+{
+    if (shouldIndex == indexed)
+        return;
+
+    indexed = shouldIndex;
+    treeRoot = nullptr;
+
+    if (indexed)
+    {
+        // nodes go in left to right, so each one joins at the far right
+        for (Node* node = firstNode; node; node = node->next())
+            indexInsert (node);
+    }
+}
+
+template <class Node>
+void LinkedList<Node>::indexInsert (Node* node)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    node->treeLeft = node->treeRight = nullptr;
+    node->treeSize = 1;
+    node->treePriority = seed;
+
+    // the new node becomes the right child of its list predecessor, or
+    // if that is taken, the left child of its list successor
+    Node* prev = node->prev();
+    Node* next = node->next();
+    if (prev != nullptr && prev->treeRight == nullptr)
+    {
+        prev->treeRight = node;
+        node->treeParent = prev;
+    }
+    else if (next != nullptr && treeRoot != nullptr)
+    {
+        jassert (next->treeLeft == nullptr);
+        next->treeLeft = node;
+        node->treeParent = next;
+    }
+    else
+    {
+        jassert (treeRoot == nullptr);
+        node->treeParent = nullptr;
+        treeRoot = node;
+        return;
+    }
+
+    for (Node* parent = node->treeParent; parent; parent = parent->treeParent)
+        ++parent->treeSize;
+
+    while (node->treeParent != nullptr && node->treeParent->treePriority < node->treePriority)
+        rotateUp (node);
+}
+
+template <class Node>
+void LinkedList<Node>::indexRemove (Node* node)
+{
+    // rotate the node down until it has at most one child
+    while (node->treeLeft != nullptr && node->treeRight != nullptr)
+        rotateUp (node->treeLeft->treePriority > node->treeRight->treePriority
+                    ? node->treeLeft : node->treeRight);
+
+    Node* child  = node->treeLeft != nullptr ? node->treeLeft : node->treeRight;
+    Node* parent = node->treeParent;
+
+    if (child != nullptr)
+        child->treeParent = parent;
+
+    if (parent == nullptr)
+        treeRoot = child;
+    else if (parent->treeLeft == node)
+        parent->treeLeft = child;
+    else
+        parent->treeRight = child;
+
+    for (; parent; parent = parent->treeParent)
+        --parent->treeSize;
+
+    node->treeParent = node->treeLeft = node->treeRight = nullptr;
+    node->treeSize = 0;
+}
+
+template <class Node>
+void LinkedList<Node>::rotateUp (Node* node)
+{
+    Node* parent = node->treeParent;
+    Node* grand  = parent->treeParent;
+
+    if (node == parent->treeLeft)
+    {
+        parent->treeLeft = node->treeRight;
+        if (parent->treeLeft != nullptr)
+            parent->treeLeft->treeParent = parent;
+        node->treeRight = parent;
+    }
+    else
+    {
+        parent->treeRight = node->treeLeft;
+        if (parent->treeRight != nullptr)
+            parent->treeRight->treeParent = parent;
+        node->treeLeft = parent;
+    }
+
+    parent->treeParent = node;
+    node->treeParent = grand;
+
+    if (grand == nullptr)
+        treeRoot = node;
+    else if (grand->treeLeft == parent)
+        grand->treeLeft = node;
+    else
+        grand->treeRight = node;
+
+    parent->treeSize = sizeOf (parent->treeLeft) + sizeOf (parent->treeRight) + 1;
+    node->treeSize   = sizeOf (node->treeLeft) + sizeOf (node->treeRight) + 1;
+}
@@ -0,0 +1,138 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+MatrixRoutingPlan::MatrixRoutingPlan (const MatrixState& matrix, const float* gains)
+    : numInputs (matrix.getNumRows()),
+      numOutputs (matrix.getNumColumns())
+{
+    offsets.calloc ((size_t) numOutputs + 1);
+    
+    // count the routes per output, then lay them out back to back
+    for (int row = 0; row < numInputs; ++row)
+        for (int col = matrix.findNextConnectedColumn (row, 0); col >= 0; col = matrix.findNextConnectedColumn (row, col + 1))
+            ++offsets [col + 1];
+
+    for (int col = 0; col < numOutputs; ++col)
+        offsets [col + 1] += offsets [col];
+
+    routes.malloc ((size_t) jmax (1, offsets [numOutputs]));
+    HeapBlock<int> fill ((size_t) jmax (1, numOutputs));
+    if (numOutputs > 0)
+        memcpy (fill.getData(), offsets.getData(), sizeof (int) * (size_t) numOutputs);
+
+    for (int row = 0; row < numInputs; ++row)
+    {
+        for (int col = matrix.findNextConnectedColumn (row, 0); col >= 0; col = matrix.findNextConnectedColumn (row, col + 1))
+        {
+            Route& route = routes [fill [col]++];
+            route.input = row;
+            route.gain  = gains != nullptr ? gains [matrix.getIndexForCell (row, col)] : 1.f;
+        }
+    }
+}
+
+void MatrixRoutingPlan::process (const float* const* inputs, int numInputChannels,
+                                 float* const* outputs, int numOutputChannels,
+                                 int numSamples) const noexcept
+{
+    for (int out = 0; out < numOutputChannels; ++out)
+    {
+        float* const dest = outputs [out];
+        bool cleared = false;
+
+        if (out < numOutputs)
+        {
+            const Route* route = getRoutes (out);
+            const Route* const end = route + getNumRoutes (out);
+
+            for (; route != end; ++route)
+            {
+                if (route->input >= numInputChannels)
+                    continue;
+
+                const float* const src = inputs [route->input];
+                if (! cleared)
+                {
+                    if (route->gain == 1.f)
+                        FloatVectorOperations::copy (dest, src, numSamples);
+                    else
+                        FloatVectorOperations::copyWithMultiply (dest, src, route->gain, numSamples);
+                    cleared = true;
+                }
+                else
+                {
+                    if (route->gain == 1.f)
+                        FloatVectorOperations::add (dest, src, numSamples);
+                    else
+                        FloatVectorOperations::addWithMultiply (dest, src, route->gain, numSamples);
+                }
+            }
+        }
+
+        if (! cleared)
+            FloatVectorOperations::clear (dest, numSamples);
+    }
+}
+
+MatrixRouter::~MatrixRouter()
+{
+    delete pending.exchange (nullptr);
+    deleteList (retired.exchange (nullptr));
+    delete active;
+    active = nullptr;
+}
+
+void MatrixRouter::update (const MatrixState& matrix, const float* gains)
+{
+    // anything still pending was never seen by the audio thread
+    delete pending.exchange (new MatrixRoutingPlan (matrix, gains));
+    collectGarbage();
+}
+
+const MatrixRoutingPlan* MatrixRouter::acquire() noexcept
+{
+    if (MatrixRoutingPlan* next = pending.exchange (nullptr))
+    {
+        if (MatrixRoutingPlan* old = active)
+        {
+            old->nextRetired = retired.load();
+            while (! retired.compare_exchange_weak (old->nextRetired, old))
+                ;
+        }
+
+        active = next;
+    }
+
+    return active;
+}
+
+void MatrixRouter::collectGarbage()
+{
+    deleteList (retired.exchange (nullptr));
+}
+
+void MatrixRouter::deleteList (MatrixRoutingPlan* plan)
+{
+    while (plan != nullptr)
+    {
+        MatrixRoutingPlan* const next = plan->nextRetired;
+        delete plan;
+        plan = next;
+    }
+}
@@ -0,0 +1,116 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#pragma once
+
+/** A compiled, read-only view of a MatrixState used for mixing.
+
+    Rows of the matrix are inputs and columns are outputs. For each output
+    the plan holds a dense list of (input, gain) routes, so the cost of
+    mixing depends on the number of connections instead of rows x columns.
+    
+    @see MatrixRouter
+ */
+class MatrixRoutingPlan
+{
+public:
+    struct Route
+    {
+        int input;
+        float gain;
+    };
+
+    /** Compile a plan from a matrix.
+        @param matrix   The connection matrix (rows = inputs, columns = outputs)
+        @param gains    Optional per-cell gains indexed by MatrixState::getIndexForCell.
+                        If nullptr, every connection has unity gain */
+    explicit MatrixRoutingPlan (const MatrixState& matrix, const float* gains = nullptr);
+    ~MatrixRoutingPlan() { }
+
+    inline int getNumInputs()  const noexcept { return numInputs; }
+    inline int getNumOutputs() const noexcept { return numOutputs; }
+
+    /** Returns the total number of routes in the plan */
+    inline int getNumRoutes() const noexcept { return offsets [numOutputs]; }
+
+    /** Returns the number of inputs routed to an output */
+    inline int getNumRoutes (int output) const noexcept
+    {
+        jassert (isPositiveAndBelow (output, numOutputs));
+        return offsets [output + 1] - offsets [output];
+    }
+
+    /** Returns the routes for an output */
+    inline const Route* getRoutes (int output) const noexcept
+    {
+        jassert (isPositiveAndBelow (output, numOutputs));
+        return routes + offsets [output];
+    }
+
+    /** Mix input channels into output channels. Outputs with no routes are
+        cleared. Input and output channels must not alias each other */
+    void process (const float* const* inputs, int numInputChannels,
+                  float* const* outputs, int numOutputChannels,
+                  int numSamples) const noexcept;
+
+private:
+    friend class MatrixRouter;
+    int numInputs = 0, numOutputs = 0;
+    HeapBlock<int> offsets;
+    HeapBlock<Route> routes;
+    MatrixRoutingPlan* nextRetired = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MatrixRoutingPlan)
+};
+
+/** Publishes MatrixRoutingPlans to the audio thread.
+
+    The message thread calls update() whenever the matrix changes. The
+    audio thread calls acquire() once at the start of each block and uses
+    the returned plan until the end of that block. Replaced plans are handed
+    back to the message thread which deletes them in collectGarbage(). The
+    audio thread never allocates, deletes or blocks.
+ */
+class MatrixRouter
+{
+public:
+    MatrixRouter() { }
+    
+    /** Deletes all plans. The audio thread must no longer be calling acquire() */
+    ~MatrixRouter();
+
+    /** Compile and publish a new plan (message thread) */
+    void update (const MatrixState& matrix, const float* gains = nullptr);
+
+    /** Returns the plan to use for the current block (audio thread). This
+        may be nullptr if update has never been called */
+    const MatrixRoutingPlan* acquire() noexcept;
+
+    /** Delete plans which the audio thread has finished with (message thread) */
+    void collectGarbage();
+
+private:
+    std::atomic<MatrixRoutingPlan*> pending { nullptr };
+    std::atomic<MatrixRoutingPlan*> retired { nullptr };
+    MatrixRoutingPlan* active = nullptr;
+
+    static void deleteList (MatrixRoutingPlan*);
+
+    JUCE_DECLARE_NON_COPYABLE (MatrixRouter)
+};
@@ -17,11 +17,116 @@
     Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
 */
 
+namespace MatrixStateHelpers
+{
+    inline static int findLowestSetBit (uint64 word) noexcept
+    {
+        jassert (word != 0);
+       #if JUCE_MSVC
+        unsigned long index = 0;
+        _BitScanForward64 (&index, word);
+        return (int) index;
+       #else
+        return __builtin_ctzll (word);
+       #endif
+    }
+
+    /** Masks off the bits past numColumns in the last word of a row */
+    inline static uint64 getTrailingMask (int numColumns) noexcept
+    {
+        const int bits = numColumns & 63;
+        return bits == 0 ? ~(uint64) 0 : (((uint64) 1 << bits) - 1);
+    }
+
+    /** Copies the overlapping region of two row-aligned bit matrices a word
+        at a time. Cells outside the overlap are left untouched in dst */
+    static void copyOverlap (uint64* dst, int dstWordsPerRow, const uint64* src, int srcWordsPerRow,
+                             int rows, int cols) noexcept
+    {
+        if (rows <= 0 || cols <= 0)
+            return;
+
+        const int fullWords = cols >> 6;
+        const uint64 mask   = getTrailingMask (cols);
+
+        for (int row = 0; row < rows; ++row)
+        {
+            uint64* d = dst + row * dstWordsPerRow;
+            const uint64* s = src + row * srcWordsPerRow;
+            
+            if (fullWords > 0)
+                memcpy (d, s, sizeof (uint64) * (size_t) fullWords);
+            if ((cols & 63) != 0)
+                d[fullWords] = (d[fullWords] & ~mask) | (s[fullWords] & mask);
+        }
+    }
+
+    /** PackBits style run length encoding */
+    static void encodeRuns (const uint8* src, size_t size, MemoryOutputStream& out)
+    {
+        size_t i = 0;
+        while (i < size)
+        {
+            size_t run = 1;
+            while (i + run < size && run < 128 && src[i + run] == src[i])
+                ++run;
+
+            if (run >= 3)
+            {
+                out.writeByte ((char) (1 - (int) run));
+                out.writeByte ((char) src[i]);
+                i += run;
+                continue;
+            }
+
+            const size_t start = i;
+            size_t length = 0;
+            while (i < size && length < 128)
+            {
+                if (i + 2 < size && src[i] == src[i + 1] && src[i] == src[i + 2])
+                    break;
+                ++i; ++length;
+            }
+
+            out.writeByte ((char) (length - 1));
+            out.write (src + start, length);
+        }
+    }
+
+    static bool decodeRuns (const uint8* src, size_t size, uint8* dst, size_t dstSize)
+    {
+        size_t i = 0, o = 0;
+        while (i < size)
+        {
+            const int header = (int) (int8) src[i++];
+            if (header >= 0)
+            {
+                const size_t length = (size_t) header + 1;
+                if (i + length > size || o + length > dstSize)
+                    return false;
+                memcpy (dst + o, src + i, length);
+                i += length;
+                o += length;
+            }
+            else if (header != -128)
+            {
+                const size_t length = (size_t) (1 - header);
+                if (i >= size || o + length > dstSize)
+                    return false;
+                memset (dst + o, src[i++], length);
+                o += length;
+            }
+        }
+
+        return o == dstSize;
+    }
+}
+
 void MatrixState::setFrom (const MatrixState& o)
 {
-    for (int row = jmin (getNumRows(), o.getNumRows()); --row >= 0;)
-        for (int col = jmin (getNumColumns(), o.getNumColumns()); --col >= 0;)
-            set (row, col, o.connected (row, col));
+    MatrixStateHelpers::copyOverlap (words.getData(), wordsPerRow, o.words.getData(), o.wordsPerRow,
+                                     jmin (getNumRows(), o.getNumRows()),
+                                     jmin (getNumColumns(), o.getNumColumns()));
 }
 
 void MatrixState::resize (int r, int c, bool retain)
@@ -29,22 +134,140 @@ void MatrixState::resize (int r, int c, bool retain)
     if (r < 0) r = 0;
     if (c < 0) c = 0;
     
-    BigInteger bits;
-    bits.setRange (0, r * c, false);
+    const int newWordsPerRow = getNumWordsForColumns (c);
+    HeapBlock<uint64> bits ((size_t) jmax (1, r * newWordsPerRow), true);
     
-    // TODO: retain set bits
     if (retain)
     {
-        const auto old = *this;
-        numRows = r; 
-        numColumns = c;
-        toggled.swapWith (bits);
-        setFrom (old);
+        MatrixStateHelpers::copyOverlap (bits.getData(), newWordsPerRow, words.getData(), wordsPerRow,
+                                         jmin (r, numRows), jmin (c, numColumns));
     }
-    else
+
+    numRows = r;
+    numColumns = c;
+    wordsPerRow = newWordsPerRow;
+    words.swapWith (bits);
+}
+
+void MatrixState::clear()
+{
+    if (numRows * wordsPerRow > 0)
+        zeromem (words.getData(), sizeof (uint64) * (size_t) (numRows * wordsPerRow));
+}
+
+int MatrixState::getNumConnectionsInRow (int row) const
+{
+    if (! isPositiveAndBelow (row, numRows))
+        return 0;
+    
+    int count = 0;
+    const uint64* const w = words + row * wordsPerRow;
+    for (int i = 0; i < wordsPerRow; ++i)
+        count += countNumberOfBits (w[i]);
+    return count;
+}
+
+int MatrixState::getNumConnectionsInColumn (int column) const
+{
+    if (! isPositiveAndBelow (column, numColumns))
+        return 0;
+
+    int count = 0;
+    for (int row = 0; row < numRows; ++row)
+        if ((getWord (row, column) & getBitMask (column)) != 0)
+            ++count;
+    return count;
+}
+
+int MatrixState::getNumConnections() const
+{
+    int count = 0;
+    for (int i = numRows * wordsPerRow; --i >= 0;)
+        count += countNumberOfBits (words[i]);
+    return count;
+}
+
+int MatrixState::findNextConnectedColumn (int row, int startColumn) const noexcept
+{
+    if (! isPositiveAndBelow (row, numRows) || startColumn >= numColumns)
+        return -1;
+    if (startColumn < 0)
+        startColumn = 0;
+
+    const uint64* const w = words + row * wordsPerRow;
+    int index = startColumn >> 6;
+    uint64 word = w[index] & (~(uint64) 0 << (startColumn & 63));
+
+    for (;;)
     {
-        numRows = r; 
-        numColumns = c;
-        toggled.swapWith (bits);
+        if (word != 0)
+            return (index << 6) + MatrixStateHelpers::findLowestSetBit (word);
+        if (++index >= wordsPerRow)
+            break;
+        word = w[index];
     }
+
+    return -1;
+}
+
+int MatrixState::findNextConnectedRow (int column, int startRow) const noexcept
+{
+    if (! isPositiveAndBelow (column, numColumns))
+        return -1;
+
+    const uint64 mask = getBitMask (column);
+    for (int row = jmax (0, startRow); row < numRows; ++row)
+        if ((getWord (row, column) & mask) != 0)
+            return row;
+
+    return -1;
+}
+
+String MatrixState::toPackedString() const
+{
+    const size_t numBytes = sizeof (uint64) * (size_t) (numRows * wordsPerRow);
+    if (numBytes == 0)
+        return {};
+
+    HeapBlock<uint8> bytes (numBytes);
+    for (int i = 0; i < numRows * wordsPerRow; ++i)
+    {
+        const uint64 word = ByteOrder::swapIfBigEndian (words[i]);
+        memcpy (bytes + i * sizeof (uint64), &word, sizeof (uint64));
+    }
+
+    MemoryOutputStream runs;
+    MatrixStateHelpers::encodeRuns (bytes, numBytes, runs);
+    return Base64::toBase64 (runs.getData(), runs.getDataSize());
+}
+
+bool MatrixState::restoreFromPackedString (const String& packed)
+{
+    clear();
+
+    const size_t numBytes = sizeof (uint64) * (size_t) (numRows * wordsPerRow);
+    if (numBytes == 0)
+        return packed.isEmpty();
+
+    MemoryOutputStream runs;
+    if (! Base64::convertFromBase64 (runs, packed))
+        return false;
+
+    HeapBlock<uint8> bytes (numBytes, true);
+    if (! MatrixStateHelpers::decodeRuns ((const uint8*) runs.getData(), runs.getDataSize(), bytes, numBytes))
+        return false;
+
+    for (int i = 0; i < numRows * wordsPerRow; ++i)
+    {
+        uint64 word;
+        memcpy (&word, bytes + i * sizeof (uint64), sizeof (uint64));
+        words[i] = ByteOrder::swapIfBigEndian (word);
+    }
+
+    // don't trust padding bits from outside sources
+    if ((numColumns & 63) != 0)
+        for (int row = 0; row < numRows; ++row)
+            words[row * wordsPerRow + wordsPerRow - 1] &= MatrixStateHelpers::getTrailingMask (numColumns);
+
+    return true;
 }
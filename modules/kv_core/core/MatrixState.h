@@ -25,23 +25,24 @@ public:
     MatrixState()
     {
         numRows = numColumns = 0;
+        wordsPerRow = 0;
     }
 
     MatrixState (const int rows, const int cols)
     {
-        numRows = rows;
-        numColumns = cols;
+        numRows = numColumns = 0;
+        wordsPerRow = 0;
         jassert (rows >= 0 && cols >= 0);
-        toggled.setRange (0, numRows * numColumns, false);
+        resize (rows, cols, false);
     }
 
     virtual ~MatrixState() { }
     
     inline const bool isEmpty() const { return numRows <= 0 && numColumns <= 0; }
     inline const bool isNotEmpty() const { return !isEmpty(); }
-    inline const bool isValid (int row, int column)
+    inline const bool isValid (int row, int column) const
     {
-        return isPositiveAndBelow (row, numRows) ||
+        return isPositiveAndBelow (row, numRows) &&
                isPositiveAndBelow (column, numColumns);
     }
     
@@ -51,18 +52,18 @@ public:
    
     inline void connect (int row, int column)
     {
-        if (isValid (row, column)) {
-            const int index = getIndexForCell (row, column);
-            toggled.setBit (index, true);
-        }
+        if (isValid (row, column))
+            getWord (row, column) |= getBitMask (column);
     }
     
     inline void set (int r, int c, bool on)
     {
         if (isValid (r, c))
         {
-            const int index = getIndexForCell (r, c);
-            toggled.setBit (index, on);
+            if (on)
+                getWord (r, c) |= getBitMask (c);
+            else
+                getWord (r, c) &= ~getBitMask (c);
         }
     }
     
@@ -72,12 +73,11 @@ public:
     {
         if (! isValid (row, column))
             return;
-        const int index = getIndexForCell (row, column);
-        toggled.setBit (index, false);
+        getWord (row, column) &= ~getBitMask (column);
     }
     
     inline bool connected (const int row, const int col) const {
-        return toggled [getIndexForCell (row, col)];
+        return isValid (row, col) && (getWord (row, col) & getBitMask (col)) != 0;
     }
     
     inline bool isCellToggled (int r, int c) const { return connected (r, c); }
@@ -85,15 +85,44 @@ public:
     {
         if (isValid (row, column))
         {
-            const int index = getIndexForCell (row, column);
-            toggled.setBit (index, ! toggled[index]);
+            getWord (row, column) ^= getBitMask (column);
             return true;
         }
 
         return false;
     }
 
-    inline bool connectedAtIndex (const int index) const { return toggled [index]; }
+    inline bool connectedAtIndex (const int index) const
+    {
+        return numColumns > 0 && index >= 0
+            && connected (index / numColumns, index % numColumns);
+    }
+
+    /** Returns the number of connected cells in a row */
+    int getNumConnectionsInRow (int row) const;
+
+    /** Returns the number of connected cells in a column */
+    int getNumConnectionsInColumn (int column) const;
+
+    /** Returns the number of connected cells in the whole matrix */
+    int getNumConnections() const;
+
+    /** Finds the next connected column in a row, starting at (and including)
+        startColumn. Returns -1 if there are no more connections in the row.
+
+        @code
+        for (int c = m.findNextConnectedColumn (r, 0); c >= 0; c = m.findNextConnectedColumn (r, c + 1))
+            ...
+        @endcode
+     */
+    int findNextConnectedColumn (int row, int startColumn) const noexcept;
+
+    /** Finds the next connected row in a column, starting at (and including)
+        startRow. Returns -1 if there are no more connections in the column. */
+    int findNextConnectedRow (int column, int startRow) const noexcept;
+
+    /** Clears all connections without changing the size */
+    void clear();
 
    #if JUCE_MODULE_AVAILABLE_juce_data_structures
     inline ValueTree createValueTree (const String& type = "matrix") const
@@ -101,17 +130,37 @@ public:
         ValueTree tree (Identifier::isValidIdentifier(type) ? type : "matrix");
         tree.setProperty ("numRows", numRows, nullptr);
         tree.setProperty ("numColumns", numColumns, nullptr);
-        tree.setProperty ("toggled", toggled.toString(2), nullptr);
+        tree.setProperty ("packed", toPackedString(), nullptr);
         return tree;
     }
 
     inline void restoreFromValueTree (const ValueTree& tree)
     {
-        numRows = tree.getProperty ("numRows", 0);
-        numColumns = tree.getProperty ("numColumns", 0);
-        toggled.parseString (tree.getProperty("toggled").toString(), 2);
+        resize (tree.getProperty ("numRows", 0), tree.getProperty ("numColumns", 0), false);
+
+        if (tree.hasProperty ("packed"))
+        {
+            restoreFromPackedString (tree.getProperty ("packed").toString());
+        }
+        else
+        {
+            // legacy format: one binary digit per cell
+            BigInteger toggled;
+            toggled.parseString (tree.getProperty("toggled").toString(), 2);
+            for (int bit = toggled.findNextSetBit (0); bit >= 0; bit = toggled.findNextSetBit (bit + 1))
+                if (numColumns > 0)
+                    connect (bit / numColumns, bit % numColumns);
+        }
     }
    #endif
+
+    /** Returns the connections as a base64 string of run-length encoded
+        bytes. Cells are packed row-major, one bit each */
+    String toPackedString() const;
+
+    /** Restores connections from a string made with toPackedString. The
+        matrix should already be sized to match */
+    bool restoreFromPackedString (const String& packed);
     
     /** Resize the matrix to the specified rows and column sizes */
     void resize (int newNumRows, int newNumColumns, bool retain = false);
@@ -124,21 +173,36 @@ public:
     }
     
     MatrixState (const MatrixState& o) {
+        numRows = numColumns = 0;
+        wordsPerRow = 0;
         this->operator=(o);
     }
     
     MatrixState& operator= (const MatrixState& o) {
+        if (this == &o)
+            return *this;
         this->numRows = o.numRows;
         this->numColumns = o.numColumns;
-        this->toggled = o.toggled;
+        this->wordsPerRow = o.wordsPerRow;
+        this->words.malloc (jmax (1, numRows * wordsPerRow));
+        if (numRows * wordsPerRow > 0)
+            memcpy (words.getData(), o.words.getData(), sizeof (uint64) * (size_t) (numRows * wordsPerRow));
         return *this;
     }
     
     const bool operator==(const MatrixState& o) const {
-        return this->sameSizeAs(o) && this->toggled == o.toggled;
+        return this->sameSizeAs(o) && (numRows * wordsPerRow == 0 ||
+            memcmp (words.getData(), o.words.getData(), sizeof (uint64) * (size_t) (numRows * wordsPerRow)) == 0);
     }
     
 private:
-    BigInteger toggled;
+    // Each row starts on a 64-bit word boundary, unused bits are always zero.
+    HeapBlock<uint64> words;
     int numRows, numColumns;
+    int wordsPerRow;
+
+    inline static int getNumWordsForColumns (int cols) noexcept      { return (cols + 63) >> 6; }
+    inline static uint64 getBitMask (int column) noexcept            { return (uint64) 1 << (column & 63); }
+    inline uint64& getWord (int row, int column) noexcept            { return words [row * wordsPerRow + (column >> 6)]; }
+    inline const uint64& getWord (int row, int column) const noexcept { return words [row * wordsPerRow + (column >> 6)]; }
 };
@@ -51,7 +51,7 @@ public:
     inline uint32
     read (void* dest, uint32 size, bool advance = true)
     {
-        buffer = block.getData();
+        Vec vec1, vec2;
         fifo.prepareToRead (size, vec1.index, vec1.size, vec2.index, vec2.size);
 
         if (vec1.size > 0)
@@ -79,7 +79,7 @@ public:
     inline uint32
     write (const void* src, uint32 bytes)
     {
-        buffer = block.getData();
+        Vec vec1, vec2;
         fifo.prepareToWrite (bytes, vec1.index, vec1.size, vec2.index, vec2.size);
 
         if (vec1.size > 0)
@@ -110,7 +110,6 @@ private:
         int32 index;
     };
 
-    Vec vec1, vec2;
     AbstractFifo fifo;
     HeapBlock<uint8> block;
     uint8* buffer;
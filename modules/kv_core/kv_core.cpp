@@ -38,7 +38,9 @@
 namespace kv {
  using namespace juce;
  #include "core/Arc.cpp"
+ #include "core/ArcTopology.cpp"
  #include "core/MatrixState.cpp"
+ #include "core/MatrixRouting.cpp"
  #include "core/RingBuffer.cpp"
  #include "core/Semaphore.cpp"
  #include "core/WorkThread.cpp"
@@ -55,6 +55,15 @@
 
 #include <set>
 
+/** Config: KV_TIMESCALE_HIGH_PRECISION
+    Set this to use double precision TimeScale math (default is disabled).
+    Single precision loses whole frames once positions pass 2^24 frames,
+    about six minutes at 48kHz.
+ */
+#ifndef KV_TIMESCALE_HIGH_PRECISION
+ #define KV_TIMESCALE_HIGH_PRECISION 0
+#endif
+
 #if _MSC_VER
  #ifdef min
   #undef min
@@ -72,9 +81,11 @@ namespace kv {
 using namespace juce;
 #include "core/AudioRingBuffer.h"
 #include "core/Arc.h"
+#include "core/ArcTopology.h"
 #include "core/Atomic.h"
 #include "core/LinkedList.h"
 #include "core/MatrixState.h"
+#include "core/MatrixRouting.h"
 #include "core/MidiChannels.h"
 #include "core/Monitor.h"
 #include "core/Parameter.h"
@@ -37,7 +37,7 @@ public:
           periodSize (1024.0),
           e2(0), t0 (0), t1 (0),
           bandwidth (1.0f),
-          frequency (0),
+          frequency (44100.0 / 1024.0),
           omega (0), b (0), c (0)
     {
         reset (0.0, 1024.0, 44100.0);
@@ -75,11 +75,20 @@ public:
     }
 
     /**  Return the difference in filtered time (t1 - t0) */
-    inline double timeDiff()
+    inline double timeDiff() const
     {
         return (t1 - t0);
     }
 
+    /** Return the filtered time of the last update */
+    inline double currentTime() const { return t0; }
+
+    /** Return the time the next update is expected */
+    inline double nextTime() const { return t1; }
+
+    /** Return the filtered period, without this update's correction */
+    inline double period() const { return e2; }
+
 private:
     double samplerate, periodSize;
     double e2, t0, t1;
@@ -21,13 +21,17 @@ void TimeScale::reset()
 {
     mNodes.setScoped (true);
     mMarkers.setScoped (true);
+    mNodes.setIndexed (true);
+    mMarkers.setIndexed (true);
 
 	// Clear/reset location-markers...
     mMarkers.clear();
+    mMarkerIndex.clearQuick();
     mMarkerCursor.reset();
 
 	// Clear/reset tempo-map...
 	mNodes.clear();
+    mNodeIndex.clearQuick();
     mCursor.reset();
 
 	// There must always be one node, always.
@@ -37,6 +41,21 @@ void TimeScale::reset()
     updateScale();
 }
 
+void TimeScale::reserve (int numNodes, int numMarkers)
+{
+    mNodes.reserve (numNodes);
+    mNodeIndex.ensureStorageAllocated (numNodes);
+    mMarkers.reserve (numMarkers);
+
+	// Edits rewrite spare snapshots, so add a couple ready sized...
+    for (int i = 0; i < 2; ++i)
+    {
+        Snapshot* snapshot = new Snapshot();
+        snapshot->segments.ensureStorageAllocated (numNodes);
+        mSnapshots.add (snapshot);
+    }
+}
+
 void TimeScale::clear()
 {
     mSnapPerBeat    = 4;
@@ -62,26 +81,33 @@ void TimeScale::sync (const TimeScale& ts)
 
 	// Copy location markers...
 	mMarkers.clear();
+    mMarkers.reserve (ts.mMarkers.count());
     Marker *other_marker = ts.mMarkers.first();
     while (other_marker)
     {
-        mMarkers.append (new Marker (*other_marker));
+        Marker *marker = mMarkers.create (*other_marker);
+        marker->text = mMarkerText.getPooledString (other_marker->text);
+        mMarkers.append (marker);
         other_marker = other_marker->next();
 	}
 
+    updateMarkerIndex();
+
     mMarkerCursor.reset();
 
 	// Copy tempo-map nodes...
 	mNodes.clear();
+    mNodes.reserve (ts.mNodes.count());
     Node *other = ts.nodes().first();
     while (other)
     {
-        mNodes.append (new Node (this, other->frame,
+        mNodes.append (mNodes.create (this, other->frame,
                        other->tempo, other->beatType,
                        other->beatsPerBar, other->beatDivisor));
         other = other->next();
 	}
 
+    updateIndex();
     mCursor.reset();
     updateScale();
 }
@@ -92,6 +118,8 @@ TimeScale& TimeScale::copyFrom (const TimeScale& ts)
     {
         mNodes.setScoped (true);
         mMarkers.setScoped (true);
+        mNodes.setIndexed (true);
+        mMarkers.setIndexed (true);
 
         mSampleRate     = ts.mSampleRate;
         mSnapPerBeat    = ts.mSnapPerBeat;
@@ -116,13 +144,13 @@ void TimeScale::Node::update()
     {
         unsigned short n = (beatDivisor - beatType);
         ticksPerBeat >>= n;
-        beatRate *= float (1 << n);
+        beatRate *= Real (1 << n);
     }
     else if (beatDivisor < beatType)
     {
         unsigned short n = (beatType - beatDivisor);
         ticksPerBeat <<= n;
-        beatRate /= float (1 << n);
+        beatRate /= Real (1 << n);
 	}
 }
 
@@ -135,7 +163,8 @@ void TimeScale::Node::reset (TimeScale::Node *node)
 
     beat  = node->beatFromFrame (frame);
     tick  = node->tickFromFrame (frame);
-    pixel = ts->pixelFromFrame (frame);
+
+    // pixel is brought up to date lazily, see TimeScale::updatePixels
 }
 
 void TimeScale::Node::setTempoEx (float extempo, unsigned short beattype_ex)
@@ -176,136 +205,130 @@ void TimeScale::Cursor::reset (TimeScale::Node *n)
     node = (n ? n : ts->nodes().first());
 }
 
-TimeScale::Node* TimeScale::Cursor::seekFrame (uint64 iFrame) const
+template <typename KeyType>
+TimeScale::Node* TimeScale::Cursor::seek (KeyType Node::*key, KeyType value) const
 {
     if (node == 0)
     {
-		node = ts->nodes().first();
-		if (node == 0)
-			return 0;
-	}
+        node = ts->nodes().first();
+        if (node == 0)
+            return 0;
+    }
 
-    if (iFrame > node->frame)
+    // Sequential access stays on this node or steps to the next...
+    if (node->*key <= value)
     {
-		// Seek frame forward...
-		while (node && node->next() && iFrame >= (node->next())->frame)
-			node = node->next();
-	}
-    else if (iFrame < node->frame)
+        Node *next = node->next();
+        if (next == 0 || value < next->*key)
+            return node;
+
+        Node *after = next->next();
+        if (after == 0 || value < after->*key)
+            return node = next;
+    }
+    else if (node->prev() == 0)
     {
-		// Seek frame backward...
-		while (node && node->frame > iFrame)
-			node = node->prev();
-		if (node == 0)
-			node = ts->nodes().first();
-	}
+        return node;
+    }
 
-	return node;
+    // Otherwise binary search the node index...
+    return node = ts->findNode (key, value);
 }
 
-TimeScale::Node* TimeScale::Cursor::seekBar (unsigned short sbar) const
-{
-    if (node == 0)
-    {
-		node = ts->nodes().first();
-		if (node == 0)
-			return 0;
-	}
+TimeScale::Node* TimeScale::Cursor::seekFrame (uint64 iFrame) const { return seek (&Node::frame, iFrame); }
+TimeScale::Node* TimeScale::Cursor::seekBar (unsigned short sbar) const { return seek (&Node::bar, sbar); }
+TimeScale::Node* TimeScale::Cursor::seekBeat (unsigned int sbeat) const { return seek (&Node::beat, sbeat); }
+TimeScale::Node* TimeScale::Cursor::seekTick (uint64 stick) const { return seek (&Node::tick, stick); }
+TimeScale::Node* TimeScale::Cursor::seekPixel (int px) const { ts->updatePixels(); return seek (&Node::pixel, px); }
 
-    if (sbar > node->bar)
-    {
-		// Seek bar forward...
-        while (node && node->next() && sbar >= (node->next())->bar)
-			node = node->next();
-	}
-    else if (sbar < node->bar)
+template <typename KeyType>
+TimeScale::Node* TimeScale::findNode (KeyType Node::*key, KeyType value) const
+{
+    // Last node whose key is at or before the value, else the first node.
+    // Searching the contiguous index beats walking the list's tree...
+    int lo = 0, hi = mNodeIndex.size();
+    while (lo < hi)
     {
-		// Seek bar backward...
-        while (node && node->bar > sbar)
-			node = node->prev();
-		if (node == 0)
-			node = ts->nodes().first();
-	}
+        const int mid = (lo + hi) >> 1;
+        if (value < mNodeIndex.getUnchecked (mid)->*key)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
 
-	return node;
+    return lo > 0 ? mNodeIndex.getUnchecked (lo - 1) : mNodes.first();
 }
 
-TimeScale::Node* TimeScale::Cursor::seekBeat (unsigned int sbeat) const
+void TimeScale::updateIndex()
 {
-	if (node == 0) {
-		node = ts->nodes().first();
-		if (node == 0)
-			return 0;
-	}
-
-    if (sbeat > node->beat) {
-		// Seek beat forward...
-        while (node && node->next() && sbeat >= (node->next())->beat)
-			node = node->next();
-	}
-	else
-    if (sbeat < node->beat) {
-		// Seek beat backward...
-        while (node && node->beat > sbeat)
-			node = node->prev();
-		if (node == 0)
-			node = ts->nodes().first();
-	}
-
-	return node;
+    mNodeIndex.clearQuick();
+    mNodeIndex.ensureStorageAllocated (mNodes.count());
+    for (Node *node = mNodes.first(); node; node = node->next())
+        mNodeIndex.add (node);
 }
 
-TimeScale::Node* TimeScale::Cursor::seekTick (uint64 stick) const
+TimeScale::GridIterator::GridIterator (const TimeScale& scale, int start, int end, int subdivs)
+    : startPixel (start), endPixel (end), subdivisions (jmax (1, subdivs)),
+      node (nullptr), beatIndex (0), subIndex (0),
+      linePixel (0), lineTick (0), lineType (Bar), lineBeat (0), lineBar (0), lineSubdivision (0)
 {
-    if (node == 0)
-    {
-		node = ts->nodes().first();
-		if (node == 0)
-			return 0;
-	}
+    scale.updatePixels();
+    node = scale.findNode (&Node::pixel, startPixel);
+    if (node == nullptr)
+        return;
 
-    if (stick > node->tick)
+	// Start on the beat at or just before the first pixel...
+    beatIndex = node->beat;
+    if (startPixel > node->pixel)
     {
-		// Seek tick forward...
-        while (node && node->next() && stick >= (node->next())->tick)
-			node = node->next();
-	}
-    else if (stick < node->tick)
-    {
-		// Seek tick backward...
-        while (node && node->tick > stick)
-			node = node->prev();
-		if (node == 0)
-			node = ts->nodes().first();
-	}
-
-	return node;
+        beatIndex = node->beatFromPixel (startPixel);
+        if (beatIndex > node->beat)
+            --beatIndex;
+    }
 }
 
-TimeScale::Node* TimeScale::Cursor::seekPixel (int px) const
+bool TimeScale::GridIterator::next()
 {
-	if (node == 0) {
-		node = ts->nodes().first();
-		if (node == 0)
-			return 0;
-	}
-
-    if (px > node->pixel)
-    {
-		// Seek pixel forward...
-        while (node && node->next() && px >= (node->next())->pixel)
-			node = node->next();
-	}
-    else if (px < node->pixel)
+    while (node != nullptr)
     {
-		// Seek tick backward...
-        while (node && node->pixel > px)
-			node = node->prev();
-		if (node == 0)
-			node = ts->nodes().first();
-	}
+        const uint64 ticksPerBeat = node->ticksPerBeat;
+        const uint64 tick = node->tick + ticksPerBeat * (beatIndex - node->beat)
+                                       + ticksPerBeat * (uint64) subIndex / (uint64) subdivisions;
+
+		// Crossed into the next tempo node...
+        const Node* nextNode = node->next();
+        if (nextNode != nullptr && tick >= nextNode->tick)
+        {
+            node = nextNode;
+            beatIndex = node->beat;
+            subIndex = 0;
+            continue;
+        }
+
+        lineTick        = tick;
+        linePixel       = node->pixelFromTick (tick);
+        lineBeat        = beatIndex;
+        lineBar         = node->barFromBeat (beatIndex);
+        lineSubdivision = subIndex;
+        lineType        = subIndex != 0 ? Subdivision : node->beatIsBar (beatIndex) ? Bar : Beat;
+
+        if (++subIndex == subdivisions)
+        {
+            subIndex = 0;
+            ++beatIndex;
+        }
+
+        if (linePixel > endPixel)
+        {
+            node = nullptr;
+            break;
+        }
+
+        if (linePixel >= startPixel)
+            return true;
+    }
 
-	return node;
+    return false;
 }
 
 TimeScale::Node* TimeScale::addNode (uint64 frame_, float tempo_, unsigned short beat_type_,
@@ -353,12 +376,17 @@ TimeScale::Node* TimeScale::addNode (uint64 frame_, float tempo_, unsigned short
     }
     else
     {
-		// Add/insert a new node...
-        node = new Node (this, frame_, tempo_, beat_type_, beats_per_bar_, beat_divisor_);
+		// Add/insert a new node, reusing the storage of nodes removed
+		// before this edit...
+        mNodes.recycle();
+        node = mNodes.create (this, frame_, tempo_, beat_type_, beats_per_bar_, beat_divisor_);
+        if (node == nullptr)
+            return prev;
         if (prev)
             mNodes.insertAfter (node, prev);
 		else
             mNodes.append (node);
+        updateIndex();
 	}
 
 	// Update coefficients and positioning thereafter...
@@ -376,19 +404,56 @@ void TimeScale::updateNode (TimeScale::Node *node)
     mCursor.reset (node);
 
 	// Update positioning on all nodes thereafter...
-    Node *next = node;
-    Node *prev = next->prev();
-    while (next)
-    {
-        if (prev)
-            next->reset (prev);
-
-        prev = next;
-        next = next->next();
-	}
+    const int index = resetNodes (node);
 
 	// And update marker/bar positions too...
     updateMarkers (node->prev());
+
+    publish (index);
+}
+
+int TimeScale::resetNodes (TimeScale::Node *node)
+{
+    const int index = jmax (0, mNodes.find (node));
+    mStalePixels = jmin (mStalePixels, index);
+
+    if (Node *prev = node->prev())
+        node->reset (prev);
+
+	// A node only depends on the one before it, so stop at the
+	// first node which doesn't move...
+    for (Node *next = node->next(); next; node = next, next = next->next())
+    {
+        const uint64 frame = next->frame;
+        const uint64 tick  = next->tick;
+        const unsigned int beat  = next->beat;
+        const unsigned short bar = next->bar;
+
+        next->reset (node);
+
+        if (next->frame == frame && next->tick == tick && next->beat == beat && next->bar == bar)
+            break;
+    }
+
+    return index;
+}
+
+void TimeScale::updatePixels() const
+{
+    for (int i = mStalePixels; i < mNodeIndex.size(); ++i)
+    {
+        Node *node = mNodeIndex.getUnchecked (i);
+        node->pixel = pixelFromFrame (node->frame);
+    }
+
+    mStalePixels = mNodeIndex.size();
+}
+
+void TimeScale::updateZoom()
+{
+    mPixelRate = Real (1.2) * Real (mHorizontalZoom * mPixelsPerBeat);
+    mStalePixels = 0;
+    publish();
 }
 
 
@@ -402,30 +467,29 @@ void TimeScale::removeNode (TimeScale::Node *node)
 	// Relocate internal cursor...
     mCursor.reset(node_prev);
 
-	// Update positioning on all nodes thereafter...
-    Node *prev = node_prev;
-    Node *next = node->next();
-    while (next)
-    {
-        if (prev)
-            next->reset (prev);
-
-        prev = next;
-        next = next->next();
-	}
-
 	// Actually remove/unlink the node...
+    Node *next = node->next();
     mNodes.remove (node);
+    updateIndex();
+
+	// Update positioning on all nodes thereafter...
+    if (next)
+        resetNodes (next);
+    const int index = jmax (0, mNodes.find (node_prev));
+    mStalePixels = jmin (mStalePixels, index);
 
 	// Then update marker/bar positions too...
-    updateMarkers (prev);
+    updateMarkers (node_prev);
+
+    publish (index);
 }
 
 void TimeScale::updateScale()
 {
 	// Update time-map independent coefficients...
-    mPixelRate = 1.20f * float (mHorizontalZoom * mPixelsPerBeat);
-    mFrameRate = 60.0f * float (mSampleRate);
+    mPixelRate = Real (1.2) * Real (mHorizontalZoom * mPixelsPerBeat);
+    mFrameRate = Real (60) * Real (mSampleRate);
+    mStalePixels = 0;
 
 	// Update all nodes thereafter...
     Node *prev = 0;
@@ -442,6 +506,215 @@ void TimeScale::updateScale()
 
 	// Also update all marker/bar positions too...
     updateMarkers (mNodes.first());
+
+    publish();
+}
+
+void TimeScale::publish (int firstChanged)
+{
+    Snapshot* snapshot = findSpareSnapshot();
+    if (snapshot == nullptr)
+    {
+        snapshot = new Snapshot();
+        mSnapshots.add (snapshot);
+    }
+
+    snapshot->update (*this, mSnapshot.get(), firstChanged);
+    mSnapshot = snapshot;
+    collectGarbage();
+}
+
+// The newest snapshot only the list holds, which no reader can be about to take.
+TimeScale::Snapshot* TimeScale::findSpareSnapshot() const
+{
+    if (mSnapshotReaders.get() != 0)
+        return nullptr;
+
+    for (int i = mSnapshots.size(); --i >= 0;)
+    {
+        Snapshot* snapshot = mSnapshots.getReference(i).get();
+        if (snapshot != mSnapshot.get() && snapshot->getReferenceCount() == 1)
+            return snapshot;
+    }
+
+    return nullptr;
+}
+
+TimeScale::Snapshot::Ptr TimeScale::getSnapshot() const
+{
+    // the reader count keeps publish() and collectGarbage() from reusing
+    // or freeing a snapshot between loading the pointer and taking a
+    // reference to it
+    ++mSnapshotReaders;
+    Snapshot::Ptr snapshot = mSnapshot.get();
+    --mSnapshotReaders;
+    return snapshot;
+}
+
+void TimeScale::collectGarbage()
+{
+    if (mSnapshotReaders.get() != 0)
+        return;
+
+	// Keep the two newest spares for the next edits to rewrite...
+    int numSpares = 0;
+    for (int i = mSnapshots.size(); --i >= 0;)
+    {
+        const Snapshot* snapshot = mSnapshots.getReference(i).get();
+        if (snapshot != mSnapshot.get() && snapshot->getReferenceCount() == 1 && ++numSpares > 2)
+            mSnapshots.remove (i);
+    }
+}
+
+TimeScale::Snapshot::Snapshot()
+    : sampleRate (0), ticksPerQuarter (0), frameRate (0), pixelRate (0)
+{
+}
+
+void TimeScale::Snapshot::update (const TimeScale& ts, const Snapshot* previous, int firstChanged)
+{
+    sampleRate      = ts.mSampleRate;
+    ticksPerQuarter = ts.mTicksPerBeat;
+    frameRate       = ts.mFrameRate;
+    pixelRate       = ts.mPixelRate;
+
+    const Array<Node*>& nodes = ts.mNodeIndex;
+    const int numNodes = nodes.size();
+    segments.clearQuick();
+    segments.ensureStorageAllocated (numNodes);
+
+    // Segments before the edit can be copied from the last snapshot...
+    if (previous != nullptr && previous->frameRate == frameRate && previous->pixelRate == pixelRate
+            && previous->ticksPerQuarter == ticksPerQuarter)
+    {
+        firstChanged = jmin (firstChanged, previous->segments.size(), numNodes);
+        segments.addArray (previous->segments.begin(), firstChanged);
+    }
+    else
+    {
+        firstChanged = 0;
+    }
+
+    for (int i = firstChanged; i < numNodes; ++i)
+    {
+        const Node* node = nodes.getUnchecked (i);
+        const Segment segment = { node->frame, node->bar, node->beat, node->tick,
+                                  ts.pixelFromFrame (node->frame), node->tempo, node->beatsPerBar,
+                                  node->beatDivisor, node->ticksPerBeat, node->tickRate, node->beatRate };
+        segments.add (segment);
+    }
+}
+
+template <typename KeyType>
+const TimeScale::Snapshot::Segment* TimeScale::Snapshot::Cursor::seek (KeyType Segment::*key, KeyType value)
+{
+    if (snapshot == nullptr || snapshot->segments.size() <= 0)
+        return nullptr;
+
+    const Array<Segment>& segments = snapshot->segments;
+    const int size = segments.size();
+
+    // Sequential access stays on this segment or steps to the next...
+    if (segments.getReference(index).*key <= value)
+    {
+        if (index + 1 >= size || value < segments.getReference(index + 1).*key)
+            return &segments.getReference (index);
+
+        if (index + 2 >= size || value < segments.getReference(index + 2).*key)
+            return &segments.getReference (++index);
+    }
+
+    int lo = 0, hi = size;
+    while (lo < hi)
+    {
+        const int mid = (lo + hi) >> 1;
+        if (value < segments.getReference(mid).*key)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    index = jmax (0, lo - 1);
+    return &segments.getReference (index);
+}
+
+const TimeScale::Snapshot::Segment* TimeScale::Snapshot::Cursor::seekFrame (uint64 frame) { return seek (&Segment::frame, frame); }
+const TimeScale::Snapshot::Segment* TimeScale::Snapshot::Cursor::seekTick (uint64 tick) { return seek (&Segment::tick, tick); }
+const TimeScale::Snapshot::Segment* TimeScale::Snapshot::Cursor::seekBeat (unsigned int beat) { return seek (&Segment::beat, beat); }
+const TimeScale::Snapshot::Segment* TimeScale::Snapshot::Cursor::seekBar (unsigned short bar) { return seek (&Segment::bar, bar); }
+const TimeScale::Snapshot::Segment* TimeScale::Snapshot::Cursor::seekPixel (int x) { return seek (&Segment::pixel, x); }
+
+// These mirror the Node convertors, so a snapshot converts exactly as
+// the scale it was taken from.
+uint64 TimeScale::Snapshot::Cursor::tickFromFrame (uint64 frame)
+{
+    const Segment* s = seekFrame (frame);
+    return s ? s->tick + (uint64) uroundf ((s->tickRate * (frame - s->frame)) / snapshot->frameRate) : 0;
+}
+
+uint64 TimeScale::Snapshot::Cursor::frameFromTick (uint64 tick)
+{
+    const Segment* s = seekTick (tick);
+    return s ? s->frame + (uint64) uroundf ((snapshot->frameRate * (tick - s->tick)) / s->tickRate) : 0;
+}
+
+unsigned int TimeScale::Snapshot::Cursor::beatFromFrame (uint64 frame)
+{
+    const Segment* s = seekFrame (frame);
+    return s ? s->beat + (unsigned int) uroundf ((s->beatRate * (frame - s->frame)) / snapshot->frameRate) : 0;
+}
+
+double TimeScale::Snapshot::Cursor::beatPositionAtFrame (uint64 frame)
+{
+    const Segment* s = seekFrame (frame);
+    return s ? (double) s->beat + ((double) s->beatRate * (double) (frame - s->frame)) / (double) snapshot->frameRate : 0.0;
+}
+
+uint64 TimeScale::Snapshot::Cursor::frameAtBeatPosition (double beats)
+{
+    if (beats <= 0.0)
+        return 0;
+
+    const Segment* s = seekBeat ((unsigned int) beats);
+    return s ? s->frame + (uint64) llrint (((double) snapshot->frameRate * (beats - (double) s->beat)) / (double) s->beatRate) : 0;
+}
+
+uint64 TimeScale::Snapshot::Cursor::frameFromBeat (unsigned int beat)
+{
+    const Segment* s = seekBeat (beat);
+    return s ? s->frame + (uint64) uroundf ((snapshot->frameRate * (beat - s->beat)) / s->beatRate) : 0;
+}
+
+unsigned short TimeScale::Snapshot::Cursor::barFromFrame (uint64 frame)
+{
+    const Segment* s = seekFrame (frame);
+    return s ? s->bar + (unsigned short) uroundf ((s->beatRate * (frame - s->frame))
+                                                  / (snapshot->frameRate * s->beatsPerBar)) : 0;
+}
+
+uint64 TimeScale::Snapshot::Cursor::frameFromBar (unsigned short bar)
+{
+    const Segment* s = seekBar (bar);
+    return s ? s->frame + (uint64) uroundf ((snapshot->frameRate * s->beatsPerBar * (bar - s->bar))
+                                            / s->beatRate) : 0;
+}
+
+uint64 TimeScale::Snapshot::Cursor::tickFromPixel (int x)
+{
+    const Segment* s = seekPixel (x);
+    return s ? s->tick + (uint64) uroundf ((s->tickRate * (x - s->pixel)) / snapshot->pixelRate) : 0;
+}
+
+int TimeScale::Snapshot::Cursor::pixelFromTick (uint64 tick)
+{
+    const Segment* s = seekTick (tick);
+    return s ? s->pixel + (int) uroundf ((snapshot->pixelRate * (tick - s->tick)) / s->tickRate) : 0;
+}
+
+float TimeScale::Snapshot::Cursor::tempoAtFrame (uint64 frame)
+{
+    const Segment* s = seekFrame (frame);
+    return s ? s->tempo : 120.0f;
 }
 
 // Beat divisor (snap index) map.
@@ -468,6 +741,65 @@ int TimeScale::indexFromSnap (unsigned short snap_per_beat)
 	return 0;
 }
 
+// Batch convertors.
+void TimeScale::framesFromTicks (const uint64* ticks, uint64* frames, int numValues) const
+{
+    int i = 0;
+    while (i < numValues)
+    {
+        const Node *node = findNode (&Node::tick, ticks[i]);
+        if (node == 0)
+        {
+            std::fill (frames + i, frames + numValues, (uint64) 0);
+            return;
+        }
+
+		// Gather the run of values inside this node...
+        const Node *next = node->next();
+        const uint64 start = node->prev() ? node->tick : 0;
+        const uint64 end   = next ? next->tick : std::numeric_limits<uint64>::max();
+
+        int n = i + 1;
+        while (n < numValues && ticks[n] >= start && ticks[n] < end)
+            ++n;
+
+		// ...and convert it in one tight loop.
+        const uint64 frame = node->frame, tick = node->tick;
+        const Real frameRate = mFrameRate, tickRate = node->tickRate;
+        // offsets are never negative here, so signed conversions give the
+        // same result as uroundf and are much cheaper
+        for (; i < n; ++i)
+            frames[i] = frame + (uint64) (int64) ((frameRate * (Real) (int64) (ticks[i] - tick)) / tickRate + Real (0.5));
+    }
+}
+
+void TimeScale::ticksFromFrames (const uint64* frames, uint64* ticks, int numValues) const
+{
+    int i = 0;
+    while (i < numValues)
+    {
+        const Node *node = findNode (&Node::frame, frames[i]);
+        if (node == 0)
+        {
+            std::fill (ticks + i, ticks + numValues, (uint64) 0);
+            return;
+        }
+
+        const Node *next = node->next();
+        const uint64 start = node->prev() ? node->frame : 0;
+        const uint64 end   = next ? next->frame : std::numeric_limits<uint64>::max();
+
+        int n = i + 1;
+        while (n < numValues && frames[n] >= start && frames[n] < end)
+            ++n;
+
+        const uint64 frame = node->frame, tick = node->tick;
+        const Real frameRate = mFrameRate, tickRate = node->tickRate;
+        for (; i < n; ++i)
+            ticks[i] = tick + (uint64) (int64) ((tickRate * (Real) (int64) (frames[i] - frame)) / frameRate + Real (0.5));
+    }
+}
+
 // Tick/Frame range conversion (delta conversion).
 uint64 TimeScale::frameFromTickRange (uint64 iTickStart, uint64 iTickEnd)
 {
@@ -503,21 +835,25 @@ TimeScale::Marker* TimeScale::MarkerCursor::seekFrame (uint64 iFrame )
 			return 0;
 	}
 
-    if (iFrame > marker->frame)
+	// Sequential access stays on this marker or steps to the next...
+    if (iFrame >= marker->frame)
     {
-		// Seek frame forward...
-		while (marker && marker->next() && iFrame >= (marker->next())->frame)
-			marker = marker->next();
+        Marker *next = marker->next();
+        if (next == 0 || iFrame < next->frame)
+            return marker;
+
+        Marker *after = next->next();
+        if (after == 0 || iFrame < after->frame)
+            return marker = next;
     }
-    else if (iFrame < marker->frame)
+    else if (marker->prev() == 0)
     {
-		// Seek frame backward...
-		while (marker && marker->frame > iFrame)
-			marker = marker->prev();
-		if (marker == 0)
-			marker = ts->markers().first();
-	}
+        return marker;
+    }
 
+	// Otherwise binary search the marker index...
+    const int index = ts->findMarkerIndex (iFrame);
+    marker = index > 0 ? ts->mMarkerIndex.getUnchecked (index - 1) : ts->markers().first();
 	return marker;
 }
 
@@ -568,13 +904,18 @@ TimeScale::Marker* TimeScale::addMarker (uint64 target_frame, const std::string&
 		// Update exact matching marker...
         marker = nearest_marker;
         marker->bar = nearest_bar;
-        marker->text = txt;
-        marker->color = rgb;
+        marker->text = mMarkerText.getPooledString (String::fromUTF8 (txt.c_str()));
+        marker->color = Marker::packColor (rgb);
     }
     else
     {
-		// Add/insert a new marker...
-        marker = new Marker(target_frame, nearest_bar, txt, rgb);
+		// Add/insert a new marker, reusing removed ones' storage...
+        mMarkers.recycle();
+        marker = mMarkers.create (target_frame, nearest_bar,
+                                  mMarkerText.getPooledString (String::fromUTF8 (txt.c_str())),
+                                  Marker::packColor (rgb));
+        if (marker == nullptr)
+            return nullptr;
 
         if (nearest_marker && nearest_marker->frame > target_frame)
             mMarkers.insertBefore (marker, nearest_marker);
@@ -582,6 +923,8 @@ TimeScale::Marker* TimeScale::addMarker (uint64 target_frame, const std::string&
             mMarkers.insertAfter (marker, nearest_marker);
 		else
             mMarkers.append (marker);
+
+        updateMarkerIndex();
 	}
 
 	// Update positioning...
@@ -605,9 +948,60 @@ void TimeScale::removeMarker (TimeScale::Marker *pMarker)
 	// and relocate internal cursor...
 	Marker *pMarkerPrev = pMarker->prev();
     mMarkers.remove (pMarker);
+    updateMarkerIndex();
     mMarkerCursor.reset (pMarkerPrev);
 }
 
+void TimeScale::updateMarkerIndex()
+{
+    mMarkerIndex.clearQuick();
+    mMarkerIndex.ensureStorageAllocated (mMarkers.count());
+    for (Marker *marker = mMarkers.first(); marker; marker = marker->next())
+        mMarkerIndex.add (marker);
+}
+
+// Index of the first marker after the frame.
+int TimeScale::findMarkerIndex (uint64 frame) const
+{
+    int lo = 0, hi = mMarkerIndex.size();
+    while (lo < hi)
+    {
+        const int mid = (lo + hi) >> 1;
+        if (frame < mMarkerIndex.getUnchecked (mid)->frame)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return lo;
+}
+
+TimeScale::MarkerRange TimeScale::markersInRange (uint64 startFrame, uint64 endFrame) const
+{
+    Marker* const* const markers = mMarkerIndex.begin();
+    if (markers == nullptr || endFrame <= startFrame)
+        return MarkerRange (markers, markers);
+
+    // first marker at or after the start, first marker at or after the end
+    const int first = startFrame > 0 ? findMarkerIndex (startFrame - 1) : 0;
+    const int last  = findMarkerIndex (endFrame - 1);
+    return MarkerRange (markers + first, markers + jmax (first, last));
+}
+
+std::string TimeScale::Marker::colorString() const
+{
+    const String hex = (color >> 24) == 0xff ? String::toHexString ((int) (color & 0xffffff)).paddedLeft ('0', 6)
+                                              : String::toHexString ((int) color).paddedLeft ('0', 8);
+    return ("#" + hex.toUpperCase()).toStdString();
+}
+
+uint32 TimeScale::Marker::packColor (const std::string& color)
+{
+    const String hex = String (color).trimCharactersAtStart ("#");
+    const uint32 value = (uint32) hex.getHexValue32();
+    return hex.length() > 6 ? value : (value | 0xff000000);
+}
+
 
 // Update markers from given node position.
 void TimeScale::updateMarkers (TimeScale::Node *pNode)
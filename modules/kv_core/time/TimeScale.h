@@ -37,8 +37,8 @@ public:
         BBT
     };
 
-    TimeScale() : mDisplayFmt (Frames), mCursor (this), mMarkerCursor (this) { clear(); }
-    TimeScale (const TimeScale& ts) : mCursor (this), mMarkerCursor (this) { copyFrom (ts); }
+    TimeScale() : mDisplayFmt (Frames), mStalePixels (0), mCursor (this), mPixelRate (0), mFrameRate (0), mMarkerCursor (this) { clear(); }
+    TimeScale (const TimeScale& ts) : mStalePixels (0), mCursor (this), mPixelRate (0), mFrameRate (0), mMarkerCursor (this) { copyFrom (ts); }
     TimeScale& operator=(const TimeScale& ts) { return copyFrom (ts); }
 
     /** Reset the node list */
@@ -47,6 +47,12 @@ public:
     /** Clear/sync/initialize the list */
 	void clear();
 
+    /** Pre-allocate storage for tempo nodes and markers, and for the
+        snapshots edits publish. Once reserved, editing the scale won't
+        allocate while it holds no more than these counts. Removed nodes
+        and markers stay valid until the next one is added */
+    void reserve (int numNodes, int numMarkers = 0);
+
     /** Sync timing values from another timescale */
     void sync (const TimeScale& ts);
 
@@ -80,9 +86,15 @@ public:
     void setVerticalZoom (unsigned short vzoom) { mVerticalZoom = vzoom; }
     unsigned short verticalZoom() const { return mVerticalZoom; }
 
+   #if KV_TIMESCALE_HIGH_PRECISION
+    typedef double Real;
+   #else
+    typedef float Real;
+   #endif
+
 	// Fastest rounding-from-float helper.
-    static uint64_t uroundf (float x) { return static_cast<uint64_t> (x >= 0.0f ? x + 0.5f : x - 0.5f); }
-    static int64_t  roundf  (float x) { return static_cast<int64_t> (x >= 0.0f ? x + 0.5f : x - 0.5f); }
+    static uint64_t uroundf (Real x) { return static_cast<uint64_t> (x >= Real (0) ? x + Real (0.5) : x - Real (0.5)); }
+    static int64_t  roundf  (Real x) { return static_cast<int64_t> (x >= Real (0) ? x + Real (0.5) : x - Real (0.5)); }
 
 	// Beat divisor (snap index) accessors.
     static unsigned short snapFromIndex (int index);
@@ -201,12 +213,12 @@ public:
 		TimeScale *ts;
 
 		// Node cached coefficients.
-        float tickRate;
-        float beatRate;
+        Real tickRate;
+        Real beatRate;
 	};
 
 	// Node list accessor.
-    const LinkedList<Node>& nodes() const { return mNodes; }
+    const LinkedList<Node>& nodes() const { updatePixels(); return mNodes; }
 
 	// To optimize and keep track of current frame
 	// position, mostly like an sequence cursor/iterator.
@@ -225,12 +237,172 @@ public:
         Node* seekPixel (int x) const;
 
 	protected:
+        template <typename KeyType>
+        Node* seek (KeyType Node::*key, KeyType value) const;
+
 		TimeScale *ts;
         mutable Node *node;
 	};
 
     Cursor& cursor() { return mCursor; }
 
+    /** Walks the bar, beat and subdivision lines across a pixel range.
+
+        Lines are stepped through arithmetically within each tempo node,
+        so drawing a grid costs one conversion per visible line, with no
+        seeking, whatever the zoom.
+
+        @code
+        TimeScale::GridIterator grid (scale, 0, getWidth(), 4);
+        while (grid.next())
+            g.drawVerticalLine (grid.pixel(), 0, h);
+        @endcode
+     */
+    class GridIterator
+    {
+    public:
+        enum LineType
+        {
+            Bar = 0,
+            Beat,
+            Subdivision
+        };
+
+        /** Create an iterator for lines from startPixel to endPixel inclusive
+            @param subdivisions  Lines per beat, 1 for beats only */
+        GridIterator (const TimeScale& scale, int startPixel, int endPixel, int subdivisions = 1);
+
+        /** Move to the next line. Returns false once past the end. The
+            accessors stay safe to call after that */
+        bool next();
+
+        int pixel() const noexcept              { return linePixel; }
+        uint64 tick() const noexcept            { return lineTick; }
+        LineType type() const noexcept          { return lineType; }
+        unsigned int beat() const noexcept      { return lineBeat; }
+        unsigned short bar() const noexcept     { return lineBar; }
+        int subdivision() const noexcept        { return lineSubdivision; }
+
+    private:
+        const int startPixel, endPixel, subdivisions;
+        const Node* node;
+        unsigned int beatIndex;
+        int subIndex;
+
+        int linePixel;
+        uint64 lineTick;
+        LineType lineType;
+        unsigned int lineBeat;
+        unsigned short lineBar;
+        int lineSubdivision;
+    };
+
+    /** An immutable copy of the tempo map.
+
+        A new snapshot is published every time the scale is updated. Any
+        thread may convert with one, through a Snapshot::Cursor of its own,
+        without locking or touching the TimeScale. Snapshots nobody holds
+        any more are rewritten for later edits, rather than reallocated.
+     */
+    class Snapshot : public ReferenceCountedObject
+    {
+    public:
+        typedef ReferenceCountedObjectPtr<Snapshot> Ptr;
+
+        /** A tempo node, frozen */
+        struct Segment
+        {
+            uint64          frame;
+            unsigned short  bar;
+            unsigned int    beat;
+            uint64          tick;
+            int             pixel;
+            float           tempo;
+            unsigned short  beatsPerBar;
+            unsigned short  beatDivisor;
+            unsigned short  ticksPerBeat;
+            Real            tickRate;
+            Real            beatRate;
+        };
+
+        int getNumSegments() const noexcept { return segments.size(); }
+        const Segment& getSegment (int index) const noexcept { return segments.getReference (index); }
+
+        unsigned int getSampleRate() const noexcept { return sampleRate; }
+        unsigned short ticksPerBeat() const noexcept { return ticksPerQuarter; }
+
+        /** Seeks and converts within a snapshot. Cursors are not shared,
+            give each thread its own */
+        class Cursor
+        {
+        public:
+            Cursor() : index (0) { }
+            explicit Cursor (Snapshot* s) : snapshot (s), index (0) { }
+
+            /** Move to another snapshot, e.g. after TimeScale::getSnapshot */
+            void setSnapshot (Snapshot* s)
+            {
+                if (s != snapshot.get())
+                {
+                    snapshot = s;
+                    index = 0;
+                }
+            }
+
+            Snapshot* getSnapshot() const noexcept { return snapshot.get(); }
+
+            const Segment* seekFrame (uint64 frame);
+            const Segment* seekTick (uint64 tick);
+            const Segment* seekBeat (unsigned int beat);
+            const Segment* seekBar (unsigned short bar);
+            const Segment* seekPixel (int x);
+
+            uint64 tickFromFrame (uint64 frame);
+            uint64 frameFromTick (uint64 tick);
+            unsigned int beatFromFrame (uint64 frame);
+            uint64 frameFromBeat (unsigned int beat);
+
+            /** Beats from zero to frame, without rounding */
+            double beatPositionAtFrame (uint64 frame);
+
+            /** The frame at a fractional beat position */
+            uint64 frameAtBeatPosition (double beats);
+            unsigned short barFromFrame (uint64 frame);
+            uint64 frameFromBar (unsigned short bar);
+            uint64 tickFromPixel (int x);
+            int pixelFromTick (uint64 tick);
+            float tempoAtFrame (uint64 frame);
+
+        private:
+            Ptr snapshot;
+            int index;
+
+            template <typename KeyType>
+            const Segment* seek (KeyType Segment::*key, KeyType value);
+        };
+
+    private:
+        friend class TimeScale;
+        Snapshot();
+        void update (const TimeScale& ts, const Snapshot* previous, int firstChanged);
+
+        Array<Segment> segments;
+        unsigned int sampleRate;
+        unsigned short ticksPerQuarter;
+        Real frameRate;
+        Real pixelRate;
+
+        JUCE_DECLARE_NON_COPYABLE (Snapshot)
+    };
+
+    /** Returns the most recently published snapshot. This is safe to call
+        from any thread, including the audio thread */
+    Snapshot::Ptr getSnapshot() const;
+
+    /** Release snapshots which nobody uses anymore. Call this from the
+        thread which edits the scale */
+    void collectGarbage();
+
 	// Node list specifics.
     Node *addNode (uint64 iFrame = 0, float fTempo = 120.0f,
                    unsigned short iBeatType = 2, unsigned short iBeatsPerBar = 4,
@@ -239,9 +411,14 @@ public:
     void updateNode (Node *node);
     void removeNode (Node *node);
 
-    /** Update the timescale as a whole */
+    /** Update the timescale as a whole, and publish a new snapshot */
     void updateScale();
 
+    /** Apply a new horizontal zoom or pixels per beat. Only pixel
+        positions depend on these, and they're recomputed lazily the
+        next time one is needed */
+    void updateZoom();
+
 	// Frame/pixel convertors.
     int pixelFromFrame (int64_t frame) const { return (int) roundf ((mPixelRate * frame) / mFrameRate); }
     int64_t frameFromPixel (int x) const { return roundf ((mFrameRate * x) / mPixelRate); }
@@ -288,12 +465,14 @@ public:
 	// Tick/pixel general converters.
     uint64 tickFromPixel (int x) const
 	{
+        updatePixels();
         Node *node = mCursor.seekPixel (x);
         return (node ? node->tickFromPixel (x) : 0);
 	}
 
     int pixelFromTick (uint64 tick) const
 	{
+        updatePixels();
         Node *node = mCursor.seekTick (tick);
         return (node ? node->pixelFromTick (tick) : 0);
 	}
@@ -301,12 +480,14 @@ public:
 	// Beat/pixel composite converters.
     unsigned int beatFromPixel (int x)
 	{
+        updatePixels();
         Node *node = mCursor.seekPixel(x);
         return (node ? node->beatFromPixel(x) : 0);
 	}
 
     int pixelFromBeat (unsigned int iBeat)
 	{
+        updatePixels();
         Node *node = mCursor.seekBeat (iBeat);
         return (node ? node->pixelFromBeat(iBeat) : 0);
 	}
@@ -333,6 +514,7 @@ public:
 
     int pixelSnap (int x) const
 	{
+        updatePixels();
         Node *node = mCursor.seekPixel(x);
         return (node ? node->pixelSnap (x) : x);
 	}
@@ -419,12 +601,21 @@ public:
         return (node ? node->beatDivisor : 2);
 	}
 
-    float beatRate() const
+    Real beatRate() const
     {
         Node *node = mNodes.first();
         return (node ? node->beatRate : 60.f);
     }
     
+    /** Convert many ticks to frames at once. Values are split into runs
+        which fall within one tempo node, and each run is converted with
+        that node's coefficients, so sorted input avoids seeking entirely.
+        Results match frameFromTick exactly. */
+    void framesFromTicks (const uint64* ticks, uint64* frames, int numValues) const;
+
+    /** Convert many frames to ticks at once, see framesFromTicks */
+    void ticksFromFrames (const uint64* frames, uint64* ticks, int numValues) const;
+
 	// Tick/Frame range conversion (delta conversion).
     uint64 frameFromTickRange (uint64 tickStart, uint64 tickEnd);
     uint64 tickFromFrameRange (uint64 frameStart, uint64 frameEnd);
@@ -438,21 +629,54 @@ public:
 		// Constructor.
         Marker (uint64 iFrame, unsigned short iBar,
                 const std::string& sText, const std::string& rgbColor = std::string("#545454"))
-            : frame (iFrame), bar(iBar), text(sText), color (rgbColor) { }
+            : frame (iFrame), bar(iBar), text (String::fromUTF8 (sText.c_str())),
+              color (packColor (rgbColor)) { }
+
+        /** Takes the text as is, for interned strings, and an ARGB colour */
+        Marker (uint64 iFrame, unsigned short iBar, const String& sText, uint32 argb)
+            : frame (iFrame), bar(iBar), text(sText), color (argb) { }
 
 		// Copy constructor.
         Marker (const Marker& marker) : frame (marker.frame),
             bar (marker.bar), text(marker.text), color(marker.color) { }
 
+        /** Returns the text as UTF-8 */
+        std::string textString() const { return text.toStdString(); }
+
+        /** Returns the colour as "#RRGGBB", or "#AARRGGBB" if not opaque */
+        std::string colorString() const;
+
+        /** Packs "#RRGGBB" or "#AARRGGBB" into ARGB */
+        static uint32 packColor (const std::string& color);
+
 		// Marker keys.
 		uint64  frame;
 		unsigned short bar;
 
-		// Marker payload.
-        std::string text;
-        std::string color;
+		// Marker payload. Text is interned by the owning TimeScale.
+        String text;
+        uint32 color;
 	};
 
+    /** A run of markers, sorted by frame, for use with range-based for */
+    class MarkerRange
+    {
+    public:
+        MarkerRange (Marker* const* from, Marker* const* to) : start (from), finish (to) { }
+        Marker* const* begin() const noexcept { return start; }
+        Marker* const* end()   const noexcept { return finish; }
+        int size() const noexcept { return (int) (finish - start); }
+        bool isEmpty() const noexcept { return start == finish; }
+
+    private:
+        Marker* const* start;
+        Marker* const* finish;
+    };
+
+    /** Returns the markers at or after startFrame and before endFrame.
+        The range stays valid until a marker is added or removed */
+    MarkerRange markersInRange (uint64 startFrame, uint64 endFrame) const;
+
 	// To optimize and keep track of current frame
 	// position, mostly like an sequence cursor/iterator.
 	class MarkerCursor
@@ -502,8 +726,8 @@ public:
 
 protected:
 	// Tempo-map independent coefficients.
-    float pixelRate() const { return mPixelRate; }
-    float frameRate() const { return mFrameRate; }
+    Real pixelRate() const { return mPixelRate; }
+    Real frameRate() const { return mFrameRate; }
 
 private:
     unsigned short mSnapPerBeat;    ///< Snap per beat (divisor).
@@ -519,16 +743,42 @@ private:
 	// Tempo-map node list.
     LinkedList<Node> mNodes;
 
+    // Nodes in order, for binary searching by any key
+    Array<Node*> mNodeIndex;
+    void updateIndex();
+
+    // Node pixels from this index on are out of date
+    mutable int mStalePixels;
+    void updatePixels() const;
+    int resetNodes (Node *node);
+
+    template <typename KeyType>
+    Node* findNode (KeyType Node::*key, KeyType value) const;
+
 	// Internal node cursor.
     Cursor mCursor;
 
 	// Tempo-map independent coefficients.
-    float mPixelRate;
-    float mFrameRate;
+    Real mPixelRate;
+    Real mFrameRate;
 
 	// Location marker list.
     LinkedList<Marker> mMarkers;
 
+    // Markers in order, for range queries, and their interned text
+    Array<Marker*> mMarkerIndex;
+    StringPool mMarkerText;
+    void updateMarkerIndex();
+    int findMarkerIndex (uint64 frame) const;
+
 	// Internal node cursor.
     MarkerCursor mMarkerCursor;
+
+    // Published snapshot, plus every snapshot which may still be in use
+    // and a couple of spares for the next edits to rewrite
+    Atomic<Snapshot*> mSnapshot;
+    mutable Atomic<int> mSnapshotReaders;
+    Array<Snapshot::Ptr> mSnapshots;
+    void publish (int firstChanged = 0);
+    Snapshot* findSpareSnapshot() const;
 };
@@ -0,0 +1,59 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+void AudioCallbackHandoff::process (const float** inputs, int numInputs,
+                                    float** outputs, int numOutputs, int numSamples) noexcept
+{
+    // the counter goes odd before the callback is loaded, so swap() can
+    // tell whether a cycle could have picked up the old one
+    cycle.fetch_add (1);
+
+    if (auto* const cb = callback.load())
+    {
+        cb->audioDeviceIOCallback (inputs, numInputs, outputs, numOutputs, numSamples);
+    }
+    else
+    {
+        for (int i = 0; i < numOutputs; ++i)
+            FloatVectorOperations::clear (outputs[i], numSamples);
+    }
+
+    cycle.fetch_add (1);
+}
+
+bool AudioCallbackHandoff::swap (AudioIODeviceCallback* newCallback,
+                                 AudioIODeviceCallback*& oldCallback, int timeoutMs)
+{
+    oldCallback = callback.exchange (newCallback);
+
+    // any cycle starting from here on sees the new callback
+    const uint32 startCycle = cycle.load();
+    if ((startCycle & 1) == 0)
+        return true;
+
+    const uint32 timeout = Time::getMillisecondCounter() + (uint32) jmax (0, timeoutMs);
+    while (cycle.load() == startCycle)
+    {
+        if (Time::getMillisecondCounter() >= timeout)
+            return false;
+        Thread::yield();
+    }
+
+    return true;
+}
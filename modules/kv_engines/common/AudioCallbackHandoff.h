@@ -0,0 +1,56 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#pragma once
+
+/** Passes an audio device's callback from one thread to the audio thread
+    without locking
+
+    The audio thread calls process() every cycle, which never waits. Other
+    threads call swap() to replace the callback. It returns once no cycle
+    can still be using the old one, so that one can be stopped safely.
+ */
+class AudioCallbackHandoff
+{
+public:
+    AudioCallbackHandoff() = default;
+
+    /** Returns the callback new cycles will run */
+    AudioIODeviceCallback* get() const noexcept { return callback.load(); }
+
+    /** Run the callback, or clear the outputs when there isn't one. Call
+        from the audio thread only */
+    void process (const float** inputs, int numInputs,
+                  float** outputs, int numOutputs, int numSamples) noexcept;
+
+    /** Install newCallback and wait for a cycle running the old one to
+        finish. oldCallback is set to the callback replaced.
+
+        Returns false if that cycle didn't finish within timeoutMs. The old
+        callback may still be running then, so it must not be stopped or
+        deleted. */
+    bool swap (AudioIODeviceCallback* newCallback, AudioIODeviceCallback*& oldCallback,
+               int timeoutMs);
+
+private:
+    std::atomic<AudioIODeviceCallback*> callback { nullptr };
+    std::atomic<uint32> cycle { 0 };    ///< odd while process() runs
+
+    JUCE_DECLARE_NON_COPYABLE (AudioCallbackHandoff)
+};
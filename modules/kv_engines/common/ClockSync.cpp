@@ -0,0 +1,435 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+namespace ClockSyncHelpers
+{
+    /** Consecutive outliers before a locked source counts as lost */
+    static const int maxMissed = 8;
+
+    /** Frame count of a time code, dropping frame numbers for 29.97 */
+    static int64 timecodeFrameCount (int hours, int minutes, int seconds, int frames, int rateCode)
+    {
+        static const int nominal[] = { 24, 25, 30, 30 };
+        const int64 totalMinutes = (int64) hours * 60 + minutes;
+        int64 count = (totalMinutes * 60 + seconds) * nominal [rateCode & 3] + frames;
+
+        if ((rateCode & 3) == 2)
+            count -= 2 * (totalMinutes - totalMinutes / 10);
+
+        return count;
+    }
+
+    static double timecodeFrameRate (int rateCode)
+    {
+        static const double rates[] = { 24.0, 25.0, 30000.0 / 1001.0, 30.0 };
+        return rates [rateCode & 3];
+    }
+}
+
+ClockSync::ClockSync()
+    : sampleRate (44100.0),
+      bandwidth (0.5),
+      blockFrame (0),
+      blockSize (0),
+      clockFramesPerBeat (22050.0),
+      clockTicks (-1),
+      clockRunning (false),
+      lastPiece (-1),
+      numPieces (0),
+      quarterFrames (-1),
+      timecodeRate (30.0)
+{
+    zeromem (timecodePieces, sizeof (timecodePieces));
+    for (auto& channel : channels)
+        resetChannel (channel);
+}
+
+ClockSync::~ClockSync() { }
+
+void ClockSync::setSampleRate (double rate)
+{
+    if (rate <= 0.0)
+        return;
+
+    {
+        SpinLock::ScopedLockType sl (lock);
+        if (sampleRate == rate)
+            return;
+        sampleRate = rate;
+    }
+
+    // every timestamp so far is in frames at the old rate
+    reset();
+}
+
+double ClockSync::getSampleRate() const { return sampleRate; }
+
+void ClockSync::setBandwidth (double hz)
+{
+    if (hz <= 0.0)
+        return;
+
+    SpinLock::ScopedLockType sl (lock);
+    bandwidth = hz;
+
+    for (auto& channel : channels)
+        if (channel.state != Unlocked)
+            channel.dll.setParams (bandwidth, sampleRate / channel.dll.timeDiff());
+
+    if (blockSize > 0)
+        audioClock.setParams (bandwidth, sampleRate / (double) blockSize);
+}
+
+void ClockSync::setMidiClockFramesPerBeat (double framesPerBeat)
+{
+    SpinLock::ScopedLockType sl (lock);
+    if (framesPerBeat > 0.0 && framesPerBeat != clockFramesPerBeat)
+    {
+        clockFramesPerBeat = framesPerBeat;
+        resetChannel (channels [MidiClock]);
+    }
+}
+
+void ClockSync::audioBlock (double hostSeconds, int numSamples)
+{
+    SpinLock::ScopedLockType sl (lock);
+
+    if (blockSize > 0)
+        blockFrame += blockSize;
+
+    const double period = (double) numSamples / sampleRate;
+
+    // restart the audio clock when the block size changes or callbacks were missed
+    if (numSamples != blockSize || std::abs (hostSeconds - audioClock.nextTime()) > period * 4.0)
+    {
+        audioClock.reset (hostSeconds, (double) numSamples, sampleRate);
+        audioClock.setParams (bandwidth, sampleRate / (double) numSamples);
+    }
+    else
+    {
+        audioClock.update (hostSeconds);
+    }
+
+    blockSize = numSamples;
+}
+
+int64 ClockSync::getBlockFrame() const
+{
+    SpinLock::ScopedLockType sl (lock);
+    return blockFrame;
+}
+
+double ClockSync::localFrameAtTime (double hostSeconds) const
+{
+    SpinLock::ScopedLockType sl (lock);
+    return frameAtTime (hostSeconds);
+}
+
+double ClockSync::frameAtTime (double hostSeconds) const
+{
+    if (blockSize <= 0)
+        return hostSeconds * sampleRate;
+
+    const double t0 = audioClock.currentTime();
+    const double t1 = audioClock.nextTime();
+    return (double) blockFrame + (hostSeconds - t0) * (double) blockSize / (t1 - t0);
+}
+
+void ClockSync::addTimestamp (Source source, double localFrame, double remoteFrame)
+{
+    if (! isPositiveAndBelow ((int) source, (int) numSources))
+        return;
+
+    SpinLock::ScopedLockType sl (lock);
+    update (channels [source], localFrame, remoteFrame);
+}
+
+void ClockSync::handleMidiMessage (const MidiMessage& message)
+{
+    SpinLock::ScopedLockType sl (lock);
+    const double localFrame = frameAtTime (message.getTimeStamp());
+
+    if (message.isMidiClock())
+    {
+        if (clockRunning)
+        {
+            ++clockTicks;
+            update (channels [MidiClock], localFrame,
+                    (double) clockTicks * clockFramesPerBeat / 24.0);
+        }
+    }
+    else if (message.isMidiStart() || message.isMidiContinue())
+    {
+        // the first tick after a start is the song's first
+        if (message.isMidiStart())
+            clockTicks = -1;
+        clockRunning = true;
+        resetChannel (channels [MidiClock]);
+    }
+    else if (message.isMidiStop())
+    {
+        clockRunning = false;
+        resetChannel (channels [MidiClock]);
+    }
+    else if (message.isSongPositionPointer())
+    {
+        clockTicks = (int64) message.getSongPositionPointerMidiBeat() * 6 - 1;
+        resetChannel (channels [MidiClock]);
+    }
+    else if (message.isQuarterFrame())
+    {
+        handleQuarterFrame (message.getQuarterFrameSequenceNumber(),
+                            message.getQuarterFrameValue(), localFrame);
+    }
+    else if (message.isFullFrame())
+    {
+        // a locate. Quarter frames pick the position up again once running
+        lastPiece = -1;
+        numPieces = 0;
+        quarterFrames = -1;
+        resetChannel (channels [MidiTimecode]);
+    }
+}
+
+void ClockSync::handleQuarterFrame (int piece, int value, double localFrame)
+{
+    using namespace ClockSyncHelpers;
+
+    timecodePieces [piece & 7] = (uint8) (value & 0x0f);
+
+    // count quarter frames while they arrive in order; backwards or
+    // missing pieces drop the count until the next complete time code
+    const bool inOrder = piece == ((lastPiece + 1) & 7);
+    numPieces     = inOrder ? jmin (8, numPieces + 1) : 1;
+    quarterFrames = inOrder && quarterFrames >= 0 ? quarterFrames + 1 : -1;
+    lastPiece     = piece;
+
+    if (piece == 7 && numPieces == 8)
+    {
+        const uint8* p = timecodePieces;
+        const int rateCode = (p[7] >> 1) & 3;
+        const int64 frames = timecodeFrameCount (p[6] | ((p[7] & 1) << 4), p[4] | (p[5] << 4),
+                                                 p[2] | (p[3] << 4), p[0] | (p[1] << 4), rateCode);
+
+        // the time code is for piece 0, seven quarter frames ago
+        quarterFrames = frames * 4 + 7;
+        timecodeRate  = timecodeFrameRate (rateCode);
+    }
+
+    if (quarterFrames >= 0)
+        update (channels [MidiTimecode], localFrame,
+                (double) quarterFrames * sampleRate / (4.0 * timecodeRate));
+}
+
+void ClockSync::resetSource (Source source)
+{
+    if (! isPositiveAndBelow ((int) source, (int) numSources))
+        return;
+
+    SpinLock::ScopedLockType sl (lock);
+    resetChannel (channels [source]);
+}
+
+void ClockSync::reset()
+{
+    SpinLock::ScopedLockType sl (lock);
+    for (auto& channel : channels)
+        resetChannel (channel);
+
+    blockFrame    = 0;
+    blockSize     = 0;
+    clockTicks    = -1;
+    clockRunning  = false;
+    lastPiece     = -1;
+    numPieces     = 0;
+    quarterFrames = -1;
+}
+
+void ClockSync::resetChannel (Channel& channel)
+{
+    channel.state         = Unlocked;
+    channel.lastLocal     = channel.lastRemote = 0.0;
+    channel.step          = 0.0;
+    channel.jitterSquared = channel.maxJitter = 0.0;
+    channel.numTimestamps = channel.numOutliers = 0;
+    channel.numSinceReset = channel.numMissed = 0;
+}
+
+void ClockSync::update (Channel& c, double localFrame, double remoteFrame)
+{
+    using namespace ClockSyncHelpers;
+    ++c.numTimestamps;
+
+    const double gap  = localFrame - c.lastLocal;
+    const double step = remoteFrame - c.lastRemote;
+
+    if (c.numSinceReset >= 2)
+    {
+        const double period = c.dll.timeDiff();
+
+        // a locate on the remote or a dropout here restarts the loop
+        if (std::abs (step - c.step) > c.step * 0.5 || gap <= 0.0 || gap > period * (double) maxMissed)
+            c.numSinceReset = 0;
+    }
+    else if (c.numSinceReset == 1 && (step <= 0.0 || gap <= 0.0))
+    {
+        c.numSinceReset = 0;
+    }
+
+    if (c.numSinceReset == 0)
+    {
+        c.state         = Unlocked;
+        c.numSinceReset = 1;
+        c.numMissed     = 0;
+    }
+    else if (c.numSinceReset == 1)
+    {
+        c.dll.reset (localFrame, gap, 1.0);
+        c.dll.setParams (bandwidth, sampleRate / gap);
+        c.state         = Locking;
+        c.jitterSquared = c.maxJitter = 0.0;
+        c.step          = step;
+        c.numSinceReset = 2;
+    }
+    else
+    {
+        const double period = c.dll.timeDiff();
+        const double error  = localFrame - c.dll.nextTime();
+
+        if (c.state == Locked && std::abs (error) > period * 0.5)
+        {
+            // too far off to be jitter. Carry on as if it came on time
+            ++c.numOutliers;
+            c.dll.update (c.dll.nextTime());
+
+            if (++c.numMissed >= maxMissed)
+            {
+                c.state         = Unlocked;
+                c.numSinceReset = 1;
+                c.numMissed     = 0;
+            }
+        }
+        else
+        {
+            c.dll.update (localFrame);
+            c.numMissed      = 0;
+            c.jitterSquared += (error * error - c.jitterSquared) / 32.0;
+
+            if (c.state == Locked)
+                c.maxJitter = jmax (c.maxJitter, std::abs (error));
+        }
+
+        c.step = step;
+
+        // call it settled after 2 / bandwidth seconds of timestamps
+        if (c.state == Locking && ++c.numSinceReset >= 2.0 * sampleRate / (period * bandwidth))
+            c.state = Locked;
+    }
+
+    c.lastLocal  = localFrame;
+    c.lastRemote = remoteFrame;
+}
+
+int ClockSync::findActive (double localFrame) const
+{
+    for (int i = 0; i < numSources; ++i)
+    {
+        const Channel& c = channels [i];
+        if (c.state != Locked)
+            continue;
+
+        const double timeout = jmax (c.dll.timeDiff() * 4.0, sampleRate * 0.25);
+        if (localFrame - c.lastLocal <= timeout)
+            return i;
+    }
+
+    return numSources;
+}
+
+bool ClockSync::getPosition (double localFrame, double& position, double& ratio) const
+{
+    SpinLock::ScopedLockType sl (lock);
+    const int active = findActive (localFrame);
+    if (active == numSources)
+        return false;
+
+    const Channel& c = channels [active];
+    const double t0 = c.dll.currentTime();
+    ratio    = c.step / c.dll.period();
+    position = c.lastRemote + (localFrame - t0) * c.step / (c.dll.nextTime() - t0);
+    return true;
+}
+
+bool ClockSync::advanceShuttle (Shuttle& shuttle, int numSamples)
+{
+    double position, ratio;
+    if (getPosition ((double) (getBlockFrame() + numSamples), position, ratio))
+    {
+        shuttle.advanceTo (llrint (position));
+        return true;
+    }
+
+    shuttle.advance (numSamples);
+    return false;
+}
+
+ClockSync::Report ClockSync::makeReport (int source) const
+{
+    Report report;
+    zerostruct (report);
+    report.source = source;
+    report.state  = Unlocked;
+    report.ratio  = 1.0;
+
+    if (isPositiveAndBelow (source, (int) numSources))
+    {
+        const Channel& c = channels [source];
+        report.state         = c.state;
+        report.jitter        = std::sqrt (c.jitterSquared);
+        report.maxJitter     = c.maxJitter;
+        report.numTimestamps = c.numTimestamps;
+        report.numOutliers   = c.numOutliers;
+
+        if (c.state != Unlocked)
+        {
+            report.period = c.dll.period();
+            report.ratio  = c.step / report.period;
+        }
+    }
+
+    return report;
+}
+
+ClockSync::Report ClockSync::getReport() const
+{
+    SpinLock::ScopedLockType sl (lock);
+
+    // as of the latest thing heard, from the audio device or any source
+    double now = (double) (blockFrame + blockSize);
+    for (const auto& channel : channels)
+        now = jmax (now, channel.lastLocal);
+
+    return makeReport (findActive (now));
+}
+
+ClockSync::Report ClockSync::getReport (Source source) const
+{
+    SpinLock::ScopedLockType sl (lock);
+    return makeReport ((int) source);
+}
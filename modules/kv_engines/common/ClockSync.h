@@ -0,0 +1,160 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#pragma once
+
+/** Recovers an external clock for slaving a Shuttle
+
+    Timestamps from JACK transport, MIDI clock and MIDI time code each pair
+    a local frame (the audio device's frame counter) with the remote
+    position, in frames at the local sample rate. A DelayLockedLoop per
+    source filters the arrival times, so the position between timestamps
+    is interpolated along the filtered period and jitter on the timestamps
+    does not reach the transport.
+
+    The source in use is the first live one in Source order. MIDI messages
+    carry host time, which is turned into local frames by a second loop
+    run on the audio callbacks; call audioBlock() at the start of each one.
+
+    Any thread may add timestamps or read reports. The audio thread only
+    holds a spin lock for as long as a few loop updates take. */
+class ClockSync
+{
+public:
+    /** Clock sources, in order of preference */
+    enum Source
+    {
+        JackTransport = 0,
+        MidiTimecode,
+        MidiClock,
+        numSources
+    };
+
+    enum LockState
+    {
+        Unlocked = 0,   ///< no timestamps, or only one since a jump
+        Locking,        ///< the loop is running but hasn't settled yet
+        Locked          ///< following the source
+    };
+
+    /** Lock state and jitter of a source */
+    struct Report
+    {
+        int       source;       ///< the source reported on, or numSources for none
+        LockState state;
+        double    ratio;        ///< remote rate over local rate
+        double    period;       ///< filtered frames between timestamps
+        double    jitter;       ///< RMS timestamp error before filtering, in frames
+        double    maxJitter;    ///< peak timestamp error since locking, in frames
+        int64     numTimestamps;
+        int64     numOutliers;  ///< timestamps ignored as too far off
+    };
+
+    ClockSync();
+    ~ClockSync();
+
+    void setSampleRate (double rate);
+    double getSampleRate() const;
+
+    /** Set the loop bandwidth in Hz. Lower rejects more jitter but follows
+        changes of rate more slowly. Defaults to 0.5 Hz */
+    void setBandwidth (double hz);
+
+    /** Frames per quarter note used to place MIDI clock ticks */
+    void setMidiClockFramesPerBeat (double framesPerBeat);
+
+    /** Start a new audio block. hostSeconds is the block's start time in
+        the same clock as MIDI timestamps */
+    void audioBlock (double hostSeconds, int numSamples);
+
+    /** The local frame at the start of the current audio block */
+    int64 getBlockFrame() const;
+
+    /** Converts a host time to a local frame, through the audio clock */
+    double localFrameAtTime (double hostSeconds) const;
+
+    /** Add a timestamp: the remote was at remoteFrame when the local clock
+        was at localFrame. A jump in either restarts the source's loop */
+    void addTimestamp (Source source, double localFrame, double remoteFrame);
+
+    /** Handles MIDI clock, song position, start/stop/continue, time code
+        quarter frames and full frame messages. The message's timestamp
+        must be host time in seconds, as from MidiInput */
+    void handleMidiMessage (const MidiMessage& message);
+
+    /** Forget a source, e.g. when it stops */
+    void resetSource (Source source);
+
+    /** Forget every source and the audio clock */
+    void reset();
+
+    /** Returns true if a locked source gave the remote position at
+        localFrame, with its rate ratio */
+    bool getPosition (double localFrame, double& position, double& ratio) const;
+
+    /** Move the shuttle to the recovered position at the end of a block
+        instead of advancing it by numSamples. Advances it normally and
+        returns false when no source is locked. Call from the audio thread */
+    bool advanceShuttle (Shuttle& shuttle, int numSamples);
+
+    /** Report on the source in use */
+    Report getReport() const;
+
+    /** Report on one source */
+    Report getReport (Source source) const;
+
+private:
+    struct Channel
+    {
+        DelayLockedLoop dll;
+        LockState state;
+        double lastLocal, lastRemote;
+        double step;
+        double jitterSquared, maxJitter;
+        int64 numTimestamps, numOutliers;
+        int numSinceReset, numMissed;
+    };
+
+    Channel channels [numSources];
+    mutable SpinLock lock;
+
+    double sampleRate, bandwidth;
+
+    DelayLockedLoop audioClock;
+    int64 blockFrame;
+    int blockSize;
+
+    double clockFramesPerBeat;
+    int64 clockTicks;
+    bool clockRunning;
+
+    uint8 timecodePieces [8];
+    int lastPiece, numPieces;
+    int64 quarterFrames;
+    double timecodeRate;    ///< real frames per second, e.g. 29.97 for drop frame
+
+    void resetChannel (Channel& channel);
+    void update (Channel& channel, double localFrame, double remoteFrame);
+    double frameAtTime (double hostSeconds) const;
+    int findActive (double localFrame) const;
+    Report makeReport (int source) const;
+    void handleQuarterFrame (int piece, int value, double localFrame);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ClockSync)
+};
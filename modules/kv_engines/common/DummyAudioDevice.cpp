@@ -0,0 +1,307 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+DummyAudioDevice::DummyAudioDevice (const String& deviceName, const Options& o)
+    : AudioIODevice (deviceName, "Dummy"),
+      Thread ("kv: dummy audio"),
+      options (o),
+      sampleRate (o.sampleRate),
+      blockSize (o.blockSize),
+      opened (false),
+      numIns (0),
+      numOuts (0)
+{
+    inputs.calloc ((size_t) jmax (1, options.numInputs));
+    outputs.calloc ((size_t) jmax (1, options.numOutputs));
+}
+
+DummyAudioDevice::~DummyAudioDevice()
+{
+    close();
+}
+
+StringArray DummyAudioDevice::getOutputChannelNames()
+{
+    StringArray names;
+    for (int i = 0; i < options.numOutputs; ++i)
+        names.add ("Output " + String (i + 1));
+    return names;
+}
+
+StringArray DummyAudioDevice::getInputChannelNames()
+{
+    StringArray names;
+    for (int i = 0; i < options.numInputs; ++i)
+        names.add ("Input " + String (i + 1));
+    return names;
+}
+
+Array<double> DummyAudioDevice::getAvailableSampleRates()
+{
+    Array<double> rates ({ 44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0 });
+    rates.addIfNotAlreadyThere (options.sampleRate);
+    rates.sort();
+    return rates;
+}
+
+Array<int> DummyAudioDevice::getAvailableBufferSizes()
+{
+    Array<int> sizes;
+    for (int size = 16; size <= 8192; size *= 2)
+        sizes.add (size);
+    sizes.addIfNotAlreadyThere (options.blockSize);
+    sizes.sort();
+    return sizes;
+}
+
+int DummyAudioDevice::getDefaultBufferSize() { return options.blockSize; }
+
+String DummyAudioDevice::open (const BigInteger& inputChannels, const BigInteger& outputChannels,
+                               double newSampleRate, int bufferSizeSamples)
+{
+    close();
+
+    sampleRate = newSampleRate > 0.0 ? newSampleRate : options.sampleRate;
+    blockSize  = bufferSizeSamples > 0 ? bufferSizeSamples : options.blockSize;
+
+    activeIns = inputChannels;
+    activeIns.setRange (options.numInputs, jmax (0, activeIns.getHighestBit() + 1 - options.numInputs), false);
+    activeOuts = outputChannels;
+    activeOuts.setRange (options.numOutputs, jmax (0, activeOuts.getHighestBit() + 1 - options.numOutputs), false);
+
+    numIns  = activeIns.countNumberOfSetBits();
+    numOuts = activeOuts.countNumberOfSetBits();
+
+    // inputs stay silent, so they only need clearing once
+    inputBuffer.setSize (jmax (1, numIns), blockSize);
+    inputBuffer.clear();
+    outputBuffer.setSize (jmax (1, numOuts), blockSize);
+
+    for (int i = 0; i < numIns; ++i)
+        inputs[i] = inputBuffer.getReadPointer (i);
+    for (int i = 0; i < numOuts; ++i)
+        outputs[i] = outputBuffer.getWritePointer (i);
+
+    resetReport();
+    numXRuns = 0;
+    lastError.clear();
+    opened = true;
+    return lastError;
+}
+
+void DummyAudioDevice::close()
+{
+    stop();
+    opened = false;
+}
+
+bool DummyAudioDevice::isOpen() { return opened; }
+
+void DummyAudioDevice::start (AudioIODeviceCallback* newCallback)
+{
+    if (! opened || newCallback == nullptr)
+        return;
+
+    newCallback->audioDeviceAboutToStart (this);
+
+    AudioIODeviceCallback* oldCallback = nullptr;
+    const bool released = callbacks.swap (newCallback, oldCallback, 2000);
+
+    if (oldCallback != nullptr && oldCallback != newCallback)
+    {
+        if (released)
+            oldCallback->audioDeviceStopped();
+        else
+            Logger::writeToLog ("[KV] dummy: callback didn't finish, the old callback wasn't stopped");
+    }
+
+    if (! isThreadRunning())
+        startThread (9);
+}
+
+void DummyAudioDevice::stop()
+{
+    signalThreadShouldExit();
+    notify();
+    stopThread (2000);
+
+    // the thread has stopped, unless a callback outlasted the timeout
+    AudioIODeviceCallback* oldCallback = nullptr;
+    if (! callbacks.swap (nullptr, oldCallback, 2000))
+        Logger::writeToLog ("[KV] dummy: callback didn't finish, the old callback wasn't stopped");
+    else if (oldCallback != nullptr)
+        oldCallback->audioDeviceStopped();
+}
+
+bool DummyAudioDevice::isPlaying()              { return callbacks.get() != nullptr; }
+String DummyAudioDevice::getLastError()         { return lastError; }
+int DummyAudioDevice::getCurrentBufferSizeSamples() { return blockSize; }
+double DummyAudioDevice::getCurrentSampleRate() { return sampleRate; }
+int DummyAudioDevice::getCurrentBitDepth()      { return 32; }
+BigInteger DummyAudioDevice::getActiveOutputChannels() const { return activeOuts; }
+BigInteger DummyAudioDevice::getActiveInputChannels()  const { return activeIns; }
+int DummyAudioDevice::getOutputLatencyInSamples()   { return blockSize; }
+int DummyAudioDevice::getInputLatencyInSamples()    { return blockSize; }
+int DummyAudioDevice::getXRunCount() const noexcept { return numXRuns.load(); }
+
+void DummyAudioDevice::getReport (Report& result) const
+{
+    SpinLock::ScopedLockType sl (reportLock);
+    result = report;
+}
+
+void DummyAudioDevice::resetReport()
+{
+    SpinLock::ScopedLockType sl (reportLock);
+    report = Report();
+    report.blockTime = (double) blockSize / sampleRate;
+}
+
+void DummyAudioDevice::waitUntil (int64 ticks)
+{
+    for (;;)
+    {
+        const double remaining = Time::highResolutionTicksToSeconds (ticks - Time::getHighResolutionTicks());
+        if (remaining <= 0.0 || threadShouldExit())
+            return;
+
+        // sleep most of the way, then yield for the last millisecond or two
+        if (remaining > 0.002)
+            wait ((int) (remaining * 1000.0) - 1);
+        else
+            Thread::yield();
+    }
+}
+
+void DummyAudioDevice::run()
+{
+    Random random (options.seed);
+    const int64 blockTicks = Time::secondsToHighResolutionTicks ((double) blockSize / sampleRate);
+    int64 deadline = Time::getHighResolutionTicks();
+
+    while (! threadShouldExit())
+    {
+        bool simulatedXRun = false;
+
+        if (options.realtime)
+        {
+            const double jitter = options.maxJitter * random.nextDouble();
+            waitUntil (deadline + Time::secondsToHighResolutionTicks (jitter));
+
+            if (random.nextDouble() < options.xrunProbability)
+            {
+                simulatedXRun = true;
+                waitUntil (Time::getHighResolutionTicks() + blockTicks);
+            }
+        }
+        else if (random.nextDouble() < options.xrunProbability)
+        {
+            simulatedXRun = true;
+        }
+
+        if (threadShouldExit())
+            break;
+
+        const int64 started = Time::getHighResolutionTicks();
+
+        // never blocks, see AudioCallbackHandoff
+        callbacks.process (inputs, numIns, outputs, numOuts, blockSize);
+
+        const int64 finished = Time::getHighResolutionTicks();
+        const double callbackTime = Time::highResolutionTicksToSeconds (finished - started);
+        const double lateness = options.realtime ? Time::highResolutionTicksToSeconds (started - deadline) : 0.0;
+
+        deadline += blockTicks;
+
+        // in realtime, finishing past the next deadline is an xrun. Drop the
+        // missed blocks rather than racing to catch up
+        bool xrun = simulatedXRun;
+        if (options.realtime && finished > deadline)
+        {
+            xrun = true;
+            deadline = finished;
+        }
+
+        if (xrun)
+            ++numXRuns;
+
+        SpinLock::ScopedLockType sl (reportLock);
+        ++report.numCallbacks;
+        report.numSamples += blockSize;
+        report.numXRuns = numXRuns.load();
+        if (simulatedXRun)
+            ++report.numSimulatedXRuns;
+        report.lastCallbackTime = callbackTime;
+        report.meanCallbackTime += (callbackTime - report.meanCallbackTime) / (double) report.numCallbacks;
+        report.maxCallbackTime  = jmax (report.maxCallbackTime, callbackTime);
+        report.maxLateness      = jmax (report.maxLateness, lateness);
+    }
+}
+
+//=============================================================================
+
+class DummyAudioDeviceType : public AudioIODeviceType
+{
+public:
+    DummyAudioDeviceType (const DummyAudioDevice::Options& o)
+        : AudioIODeviceType ("Dummy"),
+          options (o)
+    {
+        names.add ("Dummy");
+        names.add ("Offline");
+    }
+
+    void scanForDevices() override { }
+
+    StringArray getDeviceNames (bool /* forInput */) const override { return names; }
+    int getDefaultDeviceIndex (bool /* forInput */) const override  { return 0; }
+    bool hasSeparateInputsAndOutputs() const override               { return false; }
+
+    int getIndexOfDevice (AudioIODevice* device, bool /* asInput */) const override
+    {
+        return device != nullptr ? names.indexOf (device->getName()) : -1;
+    }
+
+    AudioIODevice* createDevice (const String& outputDeviceName,
+                                 const String& inputDeviceName) override
+    {
+        const String name (outputDeviceName.isNotEmpty() ? outputDeviceName : inputDeviceName);
+        if (! names.contains (name))
+            return nullptr;
+
+        DummyAudioDevice::Options deviceOptions (options);
+        deviceOptions.realtime = name == names[0];
+        return new DummyAudioDevice (name, deviceOptions);
+    }
+
+private:
+    DummyAudioDevice::Options options;
+    StringArray names;
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DummyAudioDeviceType)
+};
+
+AudioIODeviceType* DummyAudioDevice::createAudioIODeviceType (const Options& options)
+{
+    return new DummyAudioDeviceType (options);
+}
+
+AudioIODeviceType* DummyAudioDevice::createAudioIODeviceType()
+{
+    return createAudioIODeviceType (Options());
+}
@@ -0,0 +1,140 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#pragma once
+
+/** An audio device with no hardware behind it
+
+    Callbacks come from a thread of its own, either paced to the sample
+    rate like a sound card or back to back as fast as the callback
+    returns. Inputs are silent and outputs are discarded. Wake up jitter
+    and xruns can be simulated from a seeded random sequence, so a run can
+    be repeated, and the device keeps timing statistics on its callbacks.
+
+    Useful for testing and benchmarking engines on machines without a sound
+    card or JACK server.
+ */
+class DummyAudioDevice : public AudioIODevice,
+                         private Thread
+{
+public:
+    struct Options
+    {
+        double sampleRate = 44100.0;
+        int blockSize = 512;
+        int numInputs = 2;
+        int numOutputs = 2;
+
+        /** Pace callbacks to the sample rate. When false, callbacks run
+            back to back */
+        bool realtime = true;
+
+        /** Each callback may wake up late by as much as this, in seconds */
+        double maxJitter = 0.0;
+
+        /** Chance per block of stalling the device thread for a whole
+            block, as a driver would on an xrun */
+        double xrunProbability = 0.0;
+
+        /** Seeds the jitter and xrun sequence */
+        int64 seed = 0;
+    };
+
+    /** Callback timing, in seconds */
+    struct Report
+    {
+        int64 numCallbacks = 0;
+        int64 numSamples = 0;
+        int numXRuns = 0;           ///< missed deadlines, including simulated ones
+        int numSimulatedXRuns = 0;
+        double blockTime = 0.0;     ///< the time one block lasts
+        double lastCallbackTime = 0.0;
+        double meanCallbackTime = 0.0;
+        double maxCallbackTime = 0.0;
+        double maxLateness = 0.0;   ///< furthest a callback started after its deadline
+    };
+
+    DummyAudioDevice (const String& deviceName, const Options& options);
+    ~DummyAudioDevice();
+
+    /** Returns the options the device was made with */
+    const Options& getOptions() const noexcept { return options; }
+
+    /** Copy the timing statistics */
+    void getReport (Report& report) const;
+
+    /** Clear the timing statistics */
+    void resetReport();
+
+    /** Make a device type listing a realtime device and an offline one,
+        which runs as fast as possible */
+    static AudioIODeviceType* createAudioIODeviceType (const Options& options);
+
+    /** Make a device type with the default options */
+    static AudioIODeviceType* createAudioIODeviceType();
+
+    //=========================================================================
+    StringArray getOutputChannelNames() override;
+    StringArray getInputChannelNames() override;
+    Array<double> getAvailableSampleRates() override;
+    Array<int> getAvailableBufferSizes() override;
+    int getDefaultBufferSize() override;
+
+    String open (const BigInteger& inputChannels, const BigInteger& outputChannels,
+                 double sampleRate, int bufferSizeSamples) override;
+    void close() override;
+    bool isOpen() override;
+    void start (AudioIODeviceCallback* callback) override;
+    void stop() override;
+    bool isPlaying() override;
+    String getLastError() override;
+
+    int getCurrentBufferSizeSamples() override;
+    double getCurrentSampleRate() override;
+    int getCurrentBitDepth() override;
+    BigInteger getActiveOutputChannels() const override;
+    BigInteger getActiveInputChannels() const override;
+    int getOutputLatencyInSamples() override;
+    int getInputLatencyInSamples() override;
+    int getXRunCount() const noexcept override;
+
+private:
+    Options options;
+    double sampleRate;
+    int blockSize;
+    bool opened;
+    String lastError;
+
+    BigInteger activeIns, activeOuts;
+    AudioBuffer<float> inputBuffer, outputBuffer;
+    HeapBlock<const float*> inputs;
+    HeapBlock<float*> outputs;
+    int numIns, numOuts;
+
+    AudioCallbackHandoff callbacks;
+
+    Report report;
+    mutable SpinLock reportLock;
+    std::atomic<int> numXRuns { 0 };
+
+    void run() override;
+    void waitUntil (int64 ticks);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DummyAudioDevice)
+};
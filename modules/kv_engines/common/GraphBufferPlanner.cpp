@@ -0,0 +1,201 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+namespace GraphBufferPlannerHelpers
+{
+    struct LiveRange
+    {
+        uint32 nodeId;
+        uint32 port;
+        int kind;
+        int start;
+        int end;
+    };
+
+    struct AssignmentSorter
+    {
+        template<class Type>
+        static int compareElements (const Type& a, const Type& b) noexcept
+        {
+            if (a.nodeId < b.nodeId)  return -1;
+            if (a.nodeId > b.nodeId)  return 1;
+            if (a.port < b.port)      return -1;
+            if (a.port > b.port)      return 1;
+            return 0;
+        }
+    };
+}
+
+int GraphBufferPlanner::getBufferKind (PortType type) noexcept
+{
+    switch (type.id())
+    {
+        case PortType::Audio:
+        case PortType::CV:
+            return AudioBuffers;
+        case PortType::Midi:
+            return MidiBuffers;
+        default:
+            break;
+    }
+
+    return -1;
+}
+
+void GraphBufferPlanner::plan (const Array<uint32>& order, const Array<Output>& outputs,
+                               const Array<Connection>& connections)
+{
+    using namespace GraphBufferPlannerHelpers;
+
+    assignments.clearQuick();
+    for (int k = 0; k < NumBufferKinds; ++k)
+        numBuffers[k] = numOutputs[k] = 0;
+
+    HashMap<uint32, int> steps;
+    for (int i = 0; i < order.size(); ++i)
+        steps.set (order.getUnchecked (i), i);
+
+    // an output with no readers still needs a buffer while its node runs
+    Array<LiveRange> ranges;
+    ranges.ensureStorageAllocated (outputs.size());
+    for (const auto& output : outputs)
+    {
+        const int kind = getBufferKind (output.type);
+        if (kind < 0 || ! steps.contains (output.nodeId))
+            continue;
+        const int step = steps [output.nodeId];
+        ranges.add ({ output.nodeId, output.port, kind, step, step });
+    }
+
+    AssignmentSorter sorter;
+    ranges.sort (sorter);
+
+    for (const auto& c : connections)
+    {
+        if (! steps.contains (c.destNode))
+            continue;
+
+        LiveRange key = { c.sourceNode, c.sourcePort, 0, 0, 0 };
+        const int index = ranges.indexOfSorted (sorter, key);
+        if (index < 0)
+            continue;
+
+        auto& range = ranges.getReference (index);
+        const int readStep = steps [c.destNode];
+        jassert (readStep > range.start); // order must respect the arcs
+        range.end = jmax (range.end, readStep);
+    }
+
+    // walk the steps: outputs are given a slot when their node runs, and
+    // slots are released after the last reader has run
+    Array<int> startingAt, endingAt;
+    Array<int> firstStarting, firstEnding;
+    {
+        Array<int> startCounts, endCounts;
+        startCounts.insertMultiple (0, 0, order.size() + 1);
+        endCounts.insertMultiple (0, 0, order.size() + 1);
+        for (const auto& range : ranges)
+        {
+            ++startCounts.getReference (range.start + 1);
+            ++endCounts.getReference (range.end + 1);
+        }
+        for (int i = 0; i < order.size(); ++i)
+        {
+            startCounts.getReference (i + 1) += startCounts.getUnchecked (i);
+            endCounts.getReference (i + 1) += endCounts.getUnchecked (i);
+        }
+
+        firstStarting = startCounts;
+        firstEnding = endCounts;
+        startingAt.insertMultiple (0, 0, ranges.size());
+        endingAt.insertMultiple (0, 0, ranges.size());
+        for (int i = 0; i < ranges.size(); ++i)
+        {
+            const auto& range = ranges.getReference (i);
+            startingAt.set (startCounts.getReference (range.start)++, i);
+            endingAt.set (endCounts.getReference (range.end)++, i);
+        }
+    }
+
+    Array<int> slots;
+    slots.insertMultiple (0, -1, ranges.size());
+    Array<int> freeSlots [NumBufferKinds];
+
+    for (int step = 0; step < order.size(); ++step)
+    {
+        for (int i = firstStarting [step]; i < firstStarting [step + 1]; ++i)
+        {
+            const int index = startingAt.getUnchecked (i);
+            const int kind  = ranges.getReference(index).kind;
+            auto& available = freeSlots [kind];
+
+            int slot;
+            if (available.size() > 0)
+            {
+                slot = available.getLast();
+                available.removeLast();
+            }
+            else
+            {
+                slot = numBuffers [kind]++;
+            }
+
+            slots.set (index, slot);
+            ++numOutputs [kind];
+        }
+
+        for (int i = firstEnding [step]; i < firstEnding [step + 1]; ++i)
+        {
+            const int index = endingAt.getUnchecked (i);
+            freeSlots [ranges.getReference(index).kind].add (slots.getUnchecked (index));
+        }
+    }
+
+    // ranges are already sorted by node and port
+    assignments.ensureStorageAllocated (ranges.size());
+    for (int i = 0; i < ranges.size(); ++i)
+        assignments.add ({ ranges.getReference(i).nodeId, ranges.getReference(i).port, slots.getUnchecked (i) });
+}
+
+int GraphBufferPlanner::getBufferIndex (uint32 nodeId, uint32 port) const
+{
+    GraphBufferPlannerHelpers::AssignmentSorter sorter;
+    const int index = assignments.indexOfSorted (sorter, Assignment { nodeId, port, -1 });
+    return index >= 0 ? assignments.getReference(index).slot : -1;
+}
+
+void GraphBufferPlanner::createAudioBuffer (AudioBuffer<float>& buffer, int blockSize) const
+{
+    buffer.setSize (jmax (1, numBuffers [AudioBuffers]), blockSize, false, false, true);
+    buffer.clear();
+}
+
+void GraphBufferPlanner::createMidiBuffers (OwnedArray<MidiBuffer>& buffers, int eventBytes) const
+{
+    while (buffers.size() > numBuffers [MidiBuffers])
+        buffers.removeLast();
+    while (buffers.size() < numBuffers [MidiBuffers])
+        buffers.add (new MidiBuffer());
+
+    for (auto* buffer : buffers)
+    {
+        buffer->ensureSize ((size_t) eventBytes);
+        buffer->clear();
+    }
+}
@@ -0,0 +1,123 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#pragma once
+
+/** Works out how few buffers a graph needs when it is rendered in a
+    fixed order.
+
+    Every connected output port gets a live range, from the node writing
+    it to the last node reading it. Outputs whose ranges don't overlap
+    share a buffer slot. Slots are handed out greedily in processing order,
+    which is optimal for interval graphs, so the number of slots equals
+    the most buffers alive at any one step.
+
+    Audio and CV outputs share audio slots, MIDI outputs get MIDI slots.
+    Other port types are not planned.
+ */
+class GraphBufferPlanner
+{
+public:
+    /** An output port which needs a buffer */
+    struct Output
+    {
+        uint32 nodeId;
+        uint32 port;
+        PortType type;
+    };
+
+    /** An arc reduced to what the planner needs */
+    struct Connection
+    {
+        uint32 sourceNode;
+        uint32 sourcePort;
+        uint32 destNode;
+    };
+
+    enum BufferKind
+    {
+        AudioBuffers = 0,
+        MidiBuffers,
+        NumBufferKinds
+    };
+
+    GraphBufferPlanner() { }
+    ~GraphBufferPlanner() { }
+
+    /** Plan buffers.
+        @param order        Node IDs in processing order
+        @param outputs      Every output port of every node
+        @param connections  The arcs between nodes */
+    void plan (const Array<uint32>& order, const Array<Output>& outputs,
+               const Array<Connection>& connections);
+
+    /** Plan buffers from a set of arcs */
+    template<class ArcType>
+    void plan (const Array<uint32>& order, const Array<Output>& outputs,
+               const OwnedArray<ArcType>& arcs)
+    {
+        Array<Connection> connections;
+        connections.ensureStorageAllocated (arcs.size());
+        for (const auto* arc : arcs)
+            connections.add ({ arc->sourceNode, arc->sourcePort, arc->destNode });
+        plan (order, outputs, connections);
+    }
+
+    /** Returns the slot assigned to an output port, or -1 if the port has
+        no buffer. Audio slots are channel indexes in the buffer made by
+        createAudioBuffer, MIDI slots index the array made by createMidiBuffers */
+    int getBufferIndex (uint32 nodeId, uint32 port) const;
+
+    /** Returns the number of slots needed (the peak number of buffers
+        alive at once) */
+    int getNumBuffers (BufferKind kind) const noexcept { return numBuffers [kind]; }
+
+    /** Returns the number of buffers needed if every output kept its own */
+    int getNumOutputs (BufferKind kind) const noexcept { return numOutputs [kind]; }
+
+    /** Returns the number of bytes of audio saved for a block size */
+    size_t getAudioBytesSaved (int blockSize) const noexcept
+    {
+        return sizeof (float) * (size_t) blockSize
+            * (size_t) (numOutputs [AudioBuffers] - numBuffers [AudioBuffers]);
+    }
+
+    /** Resize an AudioBuffer to hold one channel per audio slot */
+    void createAudioBuffer (AudioBuffer<float>& buffer, int blockSize) const;
+
+    /** Fill an array with one MidiBuffer per MIDI slot */
+    void createMidiBuffers (OwnedArray<MidiBuffer>& buffers, int eventBytes = 2048) const;
+
+    /** Returns the kind of buffer used for a port type, or -1 */
+    static int getBufferKind (PortType type) noexcept;
+
+private:
+    struct Assignment
+    {
+        uint32 nodeId;
+        uint32 port;
+        int slot;
+    };
+
+    Array<Assignment> assignments;  // sorted by node then port
+    int numBuffers [NumBufferKinds] = { 0, 0 };
+    int numOutputs [NumBufferKinds] = { 0, 0 };
+
+    JUCE_LEAK_DETECTOR (GraphBufferPlanner)
+};
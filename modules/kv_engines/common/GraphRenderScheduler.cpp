@@ -0,0 +1,431 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+namespace GraphRenderSchedulerHelpers
+{
+    /** Spin waits with a cpu pause, twice as long each time, then falls back
+        to yielding. Keeps idle threads off the memory bus and out of the way
+        of a hyperthread sibling doing real work */
+    class Backoff
+    {
+    public:
+        void reset() noexcept { spins = 1; }
+
+        void pause() noexcept
+        {
+            if (spins > maxSpins)
+            {
+                Thread::yield();
+                return;
+            }
+
+            for (int i = 0; i < spins; ++i)
+            {
+               #if JUCE_INTEL
+                _mm_pause();
+               #elif JUCE_ARM && (JUCE_GCC || JUCE_CLANG)
+                __asm__ __volatile__ ("yield");
+               #endif
+            }
+
+            spins <<= 1;
+        }
+
+    private:
+        enum { maxSpins = 1024 };
+        int spins = 1;
+    };
+}
+
+/** A fixed size Chase-Lev work stealing deque of node indexes. Only the
+    owning thread may push and pop, any thread may steal. */
+class GraphRenderScheduler::WorkQueue
+{
+public:
+    explicit WorkQueue (int capacity)
+        : mask (nextPowerOfTwo (jmax (2, capacity)) - 1),
+          items (new std::atomic<int> [(size_t) mask + 1])
+    { }
+
+    void push (int item) noexcept
+    {
+        const int64 b = bottom.load (std::memory_order_relaxed);
+        items [b & mask].store (item, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_release);
+        bottom.store (b + 1, std::memory_order_relaxed);
+    }
+
+    int pop() noexcept
+    {
+        const int64 b = bottom.load (std::memory_order_relaxed) - 1;
+        bottom.store (b, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_seq_cst);
+        int64 t = top.load (std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            bottom.store (b + 1, std::memory_order_relaxed);
+            return -1;
+        }
+
+        int item = items [b & mask].load (std::memory_order_relaxed);
+        if (t == b)
+        {
+            // last item, race against stealers for it
+            if (! top.compare_exchange_strong (t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                item = -1;
+            bottom.store (b + 1, std::memory_order_relaxed);
+        }
+
+        return item;
+    }
+
+    int steal() noexcept
+    {
+        int64 t = top.load (std::memory_order_acquire);
+        std::atomic_thread_fence (std::memory_order_seq_cst);
+        const int64 b = bottom.load (std::memory_order_acquire);
+
+        if (t >= b)
+            return -1;
+
+        const int item = items [t & mask].load (std::memory_order_relaxed);
+        if (! top.compare_exchange_strong (t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return -1;
+
+        return item;
+    }
+
+private:
+    const int64 mask;
+    std::unique_ptr<std::atomic<int>[]> items;
+    std::atomic<int64> top { 0 };
+    std::atomic<int64> bottom { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (WorkQueue)
+};
+
+struct GraphRenderScheduler::Plan
+{
+    struct Node
+    {
+        uint32 nodeId = 0;
+        int numInputs = 0;
+        int firstOutput = 0;
+        int numOutputs = 0;
+        std::atomic<int> pendingInputs { 0 };
+        std::atomic<int64> lastTicks { 0 };
+        std::atomic<int64> maxTicks { 0 };
+    };
+
+    Plan (int nodeCount, int numThreads)
+        : numNodes (nodeCount),
+          nodes (new Node [(size_t) jmax (1, nodeCount)])
+    {
+        for (int i = 0; i < numThreads; ++i)
+            queues.add (new WorkQueue (numNodes));
+    }
+
+    const int numNodes;
+    std::unique_ptr<Node[]> nodes;
+    Array<int> outputs;
+    Array<int> roots;
+    OwnedArray<WorkQueue> queues;
+
+    std::atomic<int64> numCycles { 0 };
+    std::atomic<int64> numDeadlineMisses { 0 };
+    std::atomic<int64> lastCycleTicks { 0 };
+    std::atomic<int64> maxCycleTicks { 0 };
+
+    Plan* nextRetired = nullptr;
+};
+
+class GraphRenderScheduler::Worker : public Thread
+{
+public:
+    Worker (GraphRenderScheduler& s, int index)
+        : Thread ("kv: render worker " + String (index)),
+          scheduler (s), threadIndex (index)
+    { }
+
+    ~Worker()
+    {
+        signalThreadShouldExit();
+        sem.post();
+        stopThread (1000);
+    }
+
+    inline void wake() noexcept { sem.post(); }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            sem.wait();
+            if (threadShouldExit())
+                break;
+
+            // must be visible before reading the plan, see render()
+            scheduler.active.fetch_add (1);
+            if (Plan* plan = scheduler.current.load())
+                scheduler.work (*plan, threadIndex);
+            scheduler.active.fetch_sub (1);
+        }
+    }
+
+private:
+    GraphRenderScheduler& scheduler;
+    const int threadIndex;
+    Semaphore sem;
+};
+
+GraphRenderScheduler::GraphRenderScheduler (int numWorkerThreads, int threadPriority)
+{
+    for (int i = 0; i < numWorkerThreads; ++i)
+        workers.add (new Worker (*this, i + 1));
+    for (auto* worker : workers)
+        worker->startThread (threadPriority);
+}
+
+GraphRenderScheduler::~GraphRenderScheduler()
+{
+    workers.clear();
+    delete pending.exchange (nullptr);
+    delete current.exchange (nullptr);
+    deleteList (retired.exchange (nullptr));
+}
+
+bool GraphRenderScheduler::prepare (const Array<uint32>& nodeIds, const Array<Connection>& connections)
+{
+    HashMap<uint32, int> indexes;
+    Array<uint32> ids;
+    auto indexOf = [&] (uint32 nodeId) -> int
+    {
+        if (indexes.contains (nodeId))
+            return indexes [nodeId];
+        indexes.set (nodeId, ids.size());
+        ids.add (nodeId);
+        return ids.size() - 1;
+    };
+
+    for (const auto nodeId : nodeIds)
+        indexOf (nodeId);
+
+    Array<Array<int>> outputs;
+    for (const auto& c : connections)
+    {
+        const int source = indexOf (c.sourceNode);
+        const int dest   = indexOf (c.destNode);
+        outputs.resize (ids.size());
+        // arcs between different ports of the same nodes are one dependency
+        outputs.getReference(source).addIfNotAlreadyThere (dest);
+    }
+    outputs.resize (ids.size());
+
+    std::unique_ptr<Plan> plan (new Plan (ids.size(), getNumThreads()));
+
+    for (int i = 0; i < ids.size(); ++i)
+    {
+        auto& node = plan->nodes [i];
+        node.nodeId      = ids.getUnchecked (i);
+        node.firstOutput = plan->outputs.size();
+        node.numOutputs  = outputs.getReference(i).size();
+        plan->outputs.addArray (outputs.getReference (i));
+        for (const int dest : outputs.getReference (i))
+            ++plan->nodes[dest].numInputs;
+    }
+
+    // make sure every node can be reached, otherwise render() would never finish
+    Array<int> counts, ready;
+    for (int i = 0; i < plan->numNodes; ++i)
+    {
+        counts.add (plan->nodes[i].numInputs);
+        if (plan->nodes[i].numInputs == 0)
+        {
+            ready.add (i);
+            plan->roots.add (i);
+        }
+    }
+
+    int numVisited = 0;
+    while (ready.size() > 0)
+    {
+        const int index = ready.getLast();
+        ready.removeLast();
+        ++numVisited;
+
+        const auto& node = plan->nodes [index];
+        for (int i = 0; i < node.numOutputs; ++i)
+        {
+            const int dest = plan->outputs.getUnchecked (node.firstOutput + i);
+            if (--counts.getReference (dest) == 0)
+                ready.add (dest);
+        }
+    }
+
+    if (numVisited != plan->numNodes)
+    {
+        jassertfalse; // the graph has a cycle
+        return false;
+    }
+
+    delete pending.exchange (plan.release());
+    collectGarbage();
+    return true;
+}
+
+void GraphRenderScheduler::render (Renderer& newRenderer)
+{
+    if (Plan* next = pending.exchange (nullptr))
+    {
+        Plan* const old = current.exchange (next);
+        
+        // wait for any late worker still looking at the old plan
+        GraphRenderSchedulerHelpers::Backoff backoff;
+        while (active.load() != 0)
+            backoff.pause();
+
+        if (old != nullptr)
+        {
+            old->nextRetired = retired.load();
+            while (! retired.compare_exchange_weak (old->nextRetired, old))
+                ;
+        }
+    }
+
+    Plan* const plan = current.load();
+    if (plan == nullptr || plan->numNodes <= 0)
+        return;
+
+    const int64 startTicks = Time::getHighResolutionTicks();
+
+    for (int i = 0; i < plan->numNodes; ++i)
+        plan->nodes[i].pendingInputs.store (plan->nodes[i].numInputs, std::memory_order_relaxed);
+
+    renderer.store (&newRenderer);
+    remaining.store (plan->numNodes);
+
+    WorkQueue& queue = *plan->queues.getUnchecked (0);
+    for (const int root : plan->roots)
+        queue.push (root);
+
+    for (auto* worker : workers)
+        worker->wake();
+
+    work (*plan, 0);
+
+    const int64 ticks = Time::getHighResolutionTicks() - startTicks;
+    plan->lastCycleTicks.store (ticks, std::memory_order_relaxed);
+    if (ticks > plan->maxCycleTicks.load (std::memory_order_relaxed))
+        plan->maxCycleTicks.store (ticks, std::memory_order_relaxed);
+    plan->numCycles.fetch_add (1, std::memory_order_relaxed);
+
+    const double limit = deadline.load (std::memory_order_relaxed);
+    if (limit > 0.0 && Time::highResolutionTicksToSeconds (ticks) > limit)
+        plan->numDeadlineMisses.fetch_add (1, std::memory_order_relaxed);
+}
+
+void GraphRenderScheduler::work (Plan& plan, int threadIndex)
+{
+    const int numQueues = plan.queues.size();
+    if (! isPositiveAndBelow (threadIndex, numQueues))
+        return;
+
+    WorkQueue& queue = *plan.queues.getUnchecked (threadIndex);
+    GraphRenderSchedulerHelpers::Backoff backoff;
+
+    while (remaining.load() > 0)
+    {
+        int index = queue.pop();
+        for (int i = 1; index < 0 && i < numQueues; ++i)
+            index = plan.queues.getUnchecked ((threadIndex + i) % numQueues)->steal();
+
+        if (index < 0)
+        {
+            backoff.pause();
+            continue;
+        }
+
+        backoff.reset();
+
+        auto& node = plan.nodes [index];
+        const int64 startTicks = Time::getHighResolutionTicks();
+        renderer.load()->renderNode (node.nodeId);
+        const int64 ticks = Time::getHighResolutionTicks() - startTicks;
+
+        node.lastTicks.store (ticks, std::memory_order_relaxed);
+        if (ticks > node.maxTicks.load (std::memory_order_relaxed))
+            node.maxTicks.store (ticks, std::memory_order_relaxed);
+
+        for (int i = 0; i < node.numOutputs; ++i)
+        {
+            const int dest = plan.outputs.getUnchecked (node.firstOutput + i);
+            if (plan.nodes[dest].pendingInputs.fetch_sub (1) == 1)
+                queue.push (dest);
+        }
+
+        remaining.fetch_sub (1);
+    }
+}
+
+void GraphRenderScheduler::getReport (Report& report) const
+{
+    report.numThreads = getNumThreads();
+    report.deadline   = deadline.load();
+    report.nodes.clearQuick();
+
+    const Plan* const plan = current.load();
+    if (plan == nullptr)
+    {
+        report.numNodes = 0;
+        report.numCycles = report.numDeadlineMisses = 0;
+        report.lastCycleTime = report.maxCycleTime = 0.0;
+        return;
+    }
+
+    report.numNodes          = plan->numNodes;
+    report.numCycles         = plan->numCycles.load();
+    report.numDeadlineMisses = plan->numDeadlineMisses.load();
+    report.lastCycleTime     = Time::highResolutionTicksToSeconds (plan->lastCycleTicks.load());
+    report.maxCycleTime      = Time::highResolutionTicksToSeconds (plan->maxCycleTicks.load());
+
+    report.nodes.ensureStorageAllocated (plan->numNodes);
+    for (int i = 0; i < plan->numNodes; ++i)
+    {
+        const auto& node = plan->nodes [i];
+        report.nodes.add ({ node.nodeId,
+                            Time::highResolutionTicksToSeconds (node.lastTicks.load()),
+                            Time::highResolutionTicksToSeconds (node.maxTicks.load()) });
+    }
+}
+
+void GraphRenderScheduler::collectGarbage()
+{
+    deleteList (retired.exchange (nullptr));
+}
+
+void GraphRenderScheduler::deleteList (Plan* plan)
+{
+    while (plan != nullptr)
+    {
+        Plan* const next = plan->nextRetired;
+        delete plan;
+        plan = next;
+    }
+}
@@ -0,0 +1,137 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#pragma once
+
+/** Renders the nodes of an acyclic graph across a pool of worker threads.
+
+    prepare() turns a set of arcs into a dependency DAG and publishes it to
+    the audio thread. Each call to render() then runs one cycle: nodes with
+    no inputs are queued first, and every other node is queued as soon as
+    the last node feeding it has finished. The calling (audio) thread takes
+    part in the work and returns once every node has rendered.
+
+    Each thread has its own lock-free deque of ready nodes and steals from
+    the others when it runs dry, so independent chains of nodes spread over
+    the available cores. Nothing in render() allocates or locks.
+ */
+class GraphRenderScheduler
+{
+public:
+    /** Renders a single node. Called from the audio thread and from the
+        scheduler's worker threads, possibly at the same time for
+        different nodes */
+    class Renderer
+    {
+    public:
+        virtual ~Renderer() { }
+        virtual void renderNode (uint32 nodeId) = 0;
+    };
+
+    /** A connection between two nodes */
+    struct Connection
+    {
+        uint32 sourceNode;
+        uint32 destNode;
+    };
+
+    /** Timing for a single node, in seconds */
+    struct NodeTiming
+    {
+        uint32 nodeId;
+        double lastTime;
+        double maxTime;
+    };
+
+    /** Cycle statistics */
+    struct Report
+    {
+        int numNodes = 0;
+        int numThreads = 0;
+        int64 numCycles = 0;
+        int64 numDeadlineMisses = 0;
+        double deadline = 0.0;
+        double lastCycleTime = 0.0;
+        double maxCycleTime = 0.0;
+        Array<NodeTiming> nodes;
+    };
+
+    /** Create a scheduler.
+        @param numWorkerThreads Threads to start in addition to the audio thread
+        @param threadPriority   Priority of the worker threads (0 - 10) */
+    explicit GraphRenderScheduler (int numWorkerThreads = jmax (0, SystemStats::getNumCpus() - 1),
+                                   int threadPriority = 9);
+
+    /** Stops the workers. render() must not be running */
+    ~GraphRenderScheduler();
+
+    /** Returns the number of threads, including the audio thread */
+    int getNumThreads() const noexcept { return workers.size() + 1; }
+
+    /** Build and publish a new DAG (message thread).
+        @returns false if the arcs contain a cycle, in which case the
+                 current DAG is kept */
+    bool prepare (const Array<uint32>& nodeIds, const Array<Connection>& connections);
+
+    /** Build and publish a new DAG from a set of arcs (message thread).
+        Nodes referenced by the arcs are added automatically */
+    template<class ArcType>
+    bool prepare (const Array<uint32>& nodeIds, const OwnedArray<ArcType>& arcs)
+    {
+        Array<Connection> connections;
+        connections.ensureStorageAllocated (arcs.size());
+        for (const auto* arc : arcs)
+            connections.add ({ arc->sourceNode, arc->destNode });
+        return prepare (nodeIds, connections);
+    }
+
+    /** Set the time, in seconds, a cycle may take before it is counted as a
+        deadline miss. Typically blockSize / sampleRate. Zero disables */
+    void setDeadline (double seconds) noexcept { deadline.store (seconds); }
+
+    /** Render one cycle (audio thread) */
+    void render (Renderer& renderer);
+
+    /** Fill a report with timing from the current DAG (message thread) */
+    void getReport (Report& report) const;
+
+    /** Delete DAGs which the audio thread has finished with (message thread).
+        Called automatically by prepare() */
+    void collectGarbage();
+
+private:
+    class Worker;
+    class WorkQueue;
+    struct Plan;
+    friend class Worker;
+
+    OwnedArray<Worker> workers;
+    std::atomic<Plan*> pending { nullptr };
+    std::atomic<Plan*> current { nullptr };
+    std::atomic<Plan*> retired { nullptr };
+    std::atomic<Renderer*> renderer { nullptr };
+    std::atomic<int> remaining { 0 };
+    std::atomic<int> active { 0 };
+    std::atomic<double> deadline { 0.0 };
+
+    void work (Plan& plan, int threadIndex);
+    static void deleteList (Plan*);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GraphRenderScheduler)
+};
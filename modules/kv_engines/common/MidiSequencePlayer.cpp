@@ -21,31 +21,278 @@
 #define NOTE_VELOCITY      0.8f
 #define NOTE_PREFRAMES     0.001
 
+/** One thread merges recordings for every prepared player. It sleeps
+    until a player's audio thread has captured something */
+class MidiSequencePlayer::RecordMerger : public Thread
+{
+public:
+    RecordMerger() : Thread ("MidiRecordMerger") { startThread (3); }
+    ~RecordMerger() { stopThread (500); }
+
+    void addPlayer (MidiSequencePlayer* player)
+    {
+        const ScopedLock sl (lock);
+        players.addIfNotAlreadyThere (player);
+    }
+
+    void removePlayer (MidiSequencePlayer* player)
+    {
+        const ScopedLock sl (lock);
+        players.removeFirstMatchingValue (player);
+    }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            wait (-1);
+
+            // let a few blocks of input gather before merging them
+            wait (25);
+
+            const ScopedLock sl (lock);
+            for (auto* player : players)
+                if (player->mergePending.exchange (false))
+                    player->mergeRecording();
+        }
+    }
+
+private:
+    CriticalSection lock;
+    Array<MidiSequencePlayer*> players;
+};
+
 MidiSequencePlayer::MidiSequencePlayer()
-    : midiSequence (new MidiMessageSequence())
+    : midiSequence (new MidiMessageSequence()),
+      recordRing (1 << 16)
 {
     numBars     = 4;
     frameOffset = 0;
+    nextFrame   = -1;
+    looping     = true;
     shuttle.setOwned (new Shuttle());
 }
 
 MidiSequencePlayer::~MidiSequencePlayer ()
 {
+    releaseResources();
+    delete pendingCompiled.exchange (nullptr);
+    deleteList (retiredCompiled.exchange (nullptr));
+    delete activeCompiled;
+    activeCompiled = nullptr;
     midiSequence = nullptr;
     shuttle.clear();
 }
 
+void MidiSequencePlayer::compileSequence()
+{
+    // one compile at a time, so an older one can't publish over a newer one
+    const ScopedLock cl (compileLock);
+
+    // the merger thread compiles too, so convert with a snapshot rather
+    // than the live time scale
+    TimeScale::Snapshot::Ptr snapshot (shuttle->getTimeScale().getSnapshot());
+    ScopedPointer<Compiled> next (new Compiled());
+
+    {
+        const ScopedLock sl (sequenceLock);
+        next->buffer.compile (*midiSequence, snapshot.get());
+    }
+
+    if (looping)
+    {
+        TimeScale::Snapshot::Cursor loopCursor (snapshot.get());
+        const uint64 loopTicks = (uint64) numBars * snapshot->getSegment(0).beatsPerBar * snapshot->ticksPerBeat();
+        next->loopFrames = (int64) loopCursor.frameFromTick (loopTicks);
+    }
+
+    // anything still pending was never seen by the audio thread
+    delete pendingCompiled.exchange (next.release());
+    collectGarbage();
+}
+
+MidiSequencePlayer::Compiled* MidiSequencePlayer::acquireCompiled() noexcept
+{
+    if (Compiled* next = pendingCompiled.exchange (nullptr))
+    {
+        if (Compiled* old = activeCompiled)
+        {
+            old->nextRetired = retiredCompiled.load();
+            while (! retiredCompiled.compare_exchange_weak (old->nextRetired, old))
+                ;
+        }
+
+        activeCompiled = next;
+        cursor = Midi::RenderBuffer::Cursor();
+    }
+
+    return activeCompiled;
+}
+
+void MidiSequencePlayer::collectGarbage()
+{
+    deleteList (retiredCompiled.exchange (nullptr));
+}
+
+void MidiSequencePlayer::deleteList (Compiled* compiled)
+{
+    while (compiled != nullptr)
+    {
+        Compiled* const next = compiled->nextRetired;
+        delete compiled;
+        compiled = next;
+    }
+}
+
 void MidiSequencePlayer::prepareToPlay (double /*sampleRate*/, int /* blockSize */)
 {
-	noteOffs.clear();
+    activeNotes.reset();
+    nextFrame = -1;
+    compileSequence();
+    merger->addPlayer (this);
 }
 
 void MidiSequencePlayer::releaseResources()
-{ }
+{
+    merger->removePlayer (this);
+    mergePending = false;
+    mergeRecording();
+    collectGarbage();
+}
+
+void MidiSequencePlayer::setRecordBufferSize (int numBytes)
+{
+    recordRing.setCapacity (numBytes);
+}
+
+void MidiSequencePlayer::recordMidi (const MidiBuffer& input, int numSamples)
+{
+    if (input.isEmpty())
+        return;
+
+    // renderSequence has acquired the sequence for this block already
+    const int64 loopFrames = activeCompiled != nullptr ? activeCompiled->loopFrames : 0;
+
+    recordCursor.setSnapshot (shuttle->getTimeScale().getSnapshot());
+    const int64 blockStart = shuttle->getPositionFrames() + frameOffset;
+
+    MidiBuffer::Iterator iter (input);
+    const uint8* data; int size, pos;
+    while (iter.getNextEvent (data, size, pos))
+    {
+        if (pos >= numSamples)
+            break;
+
+        int64 frame = blockStart + pos;
+        if (loopFrames > 0)
+            frame = ((frame % loopFrames) + loopFrames) % loopFrames;
+
+        RecordHeader header;
+        header.tick = recordCursor.tickFromFrame ((uint64) jmax ((int64) 0, frame));
+        header.size = (uint32) size;
+
+        if (! recordRing.canWrite (sizeof (RecordHeader) + header.size))
+        {
+            ++numDropped;
+            continue;
+        }
+
+        recordRing.write (header);
+        recordRing.write (data, header.size);
+
+        // wake the merger once, not for every block it hasn't seen yet
+        if (! mergePending.exchange (true))
+            merger->notify();
+    }
+}
+
+int MidiSequencePlayer::mergeRecording()
+{
+    HeapBlock<uint8> data;
+    uint32 dataSize = 0;
+    int numMerged = 0;
+
+    {
+        const ScopedLock sl (sequenceLock);
+
+        RecordHeader header;
+        while (recordRing.canRead (sizeof (RecordHeader)))
+        {
+            recordRing.peak (&header, sizeof (RecordHeader));
+            if (! recordRing.canRead (sizeof (RecordHeader) + header.size))
+                break;
+
+            recordRing.advance (sizeof (RecordHeader), false);
+            if (header.size > dataSize)
+                data.allocate (dataSize = header.size, false);
+            recordRing.read (data.getData(), header.size);
+
+            midiSequence->addEvent (MidiMessage (data.getData(), (int) header.size, (double) header.tick));
+            ++numMerged;
+        }
+
+        if (numMerged > 0)
+            midiSequence->updateMatchedPairs();
+    }
+
+    if (numMerged > 0)
+        compileSequence();
+
+    return numMerged;
+}
 
 void MidiSequencePlayer::renderSequence (int numSamples, MidiBuffer& midiMessages)
 {
-    renderSequence (midiMessages, *midiSequence, 0, numSamples);
+    const Compiled* const compiled = acquireCompiled();
+    const Shuttle::State transport (shuttle->getState());
+
+    if (transport.recording && transport.playing)
+        recordMidi (midiMessages, numSamples);
+
+    if (! transport.playing)
+    {
+        activeNotes.releaseAll (midiMessages, 0);
+        nextFrame = -1;
+        return;
+    }
+
+    int64 frame = transport.framePos + frameOffset;
+
+    // transport jumped, nothing sounding should carry over...
+    if (frame != nextFrame)
+        activeNotes.releaseAll (midiMessages, 0);
+    nextFrame = frame + numSamples;
+
+    if (compiled == nullptr)
+        return;
+
+    const Midi::RenderBuffer& buffer = compiled->buffer;
+    const int64 loopFrames = compiled->loopFrames;
+
+    if (loopFrames <= 0)
+    {
+        buffer.render (midiMessages, cursor, frame, numSamples, 0, &activeNotes);
+        return;
+    }
+
+    frame %= loopFrames;
+    if (frame < 0)
+        frame += loopFrames;
+
+    for (int32 done = 0; done < numSamples;)
+    {
+        const int32 numToRender = (int32) jmin ((int64) (numSamples - done), loopFrames - frame);
+        buffer.render (midiMessages, cursor, frame, numToRender, done, &activeNotes);
+        done  += numToRender;
+        frame += numToRender;
+
+        if (frame >= loopFrames)
+        {
+            activeNotes.releaseAll (midiMessages, jmin (done, numSamples - 1));
+            cursor.index = 0;
+            cursor.frame = frame = 0;
+        }
+    }
 }
 
 void MidiSequencePlayer::renderSequence (MidiBuffer& target, const MidiMessageSequence& seq,
@@ -87,6 +334,11 @@ void MidiSequencePlayer::renderSequence (MidiBuffer& target, const MidiMessageSe
 #endif
 }
 
+int32 MidiSequencePlayer::getBeatsPerBar() const
+{
+    return (int32) shuttle->getTimeScale().beatsPerBar();
+}
+
 int32 MidiSequencePlayer::getLoopRepeatIndex() const
 {
     return static_cast<int> (floor (shuttle->getPositionBeats())) / (double) getBeatLength();
@@ -104,13 +356,27 @@ void renderSequence (MidiBuffer& target, const MidiMessageSequence& seq, const T
                      int32 startFrame, int32 numSamples)
 {
 #if 1
+    // events are converted a block at a time, see TimeScale::framesFromTicks
+    enum { blockSize = 64 };
+    uint64 ticks [blockSize], frames [blockSize];
+
     const int32 numEvents = seq.getNumEvents();
     const double start = (double) ts.tickFromFrame (startFrame);
+    int32 converted = 0, blockStart = 0;
+
     for (int32 i = seq.getNextIndexAtTime (start); i < numEvents;)
     {
+        if (i >= converted)
+        {
+            blockStart = i;
+            converted  = jmin (numEvents, i + (int32) blockSize);
+            for (int32 j = blockStart; j < converted; ++j)
+                ticks [j - blockStart] = static_cast<uint64> (seq.getEventPointer(j)->message.getTimeStamp());
+            ts.framesFromTicks (ticks, frames, converted - blockStart);
+        }
+
         const auto* const ev = seq.getEventPointer (i);
-        const double tick = ev->message.getTimeStamp();
-        const int frameInSeq = (int) ts.frameFromTick (static_cast<unsigned long> (tick));
+        const int frameInSeq = (int) frames [i - blockStart];
         const int timeStamp = frameInSeq - startFrame;
 
         if (timeStamp >= numSamples)
@@ -133,4 +399,181 @@ void renderSequence (MidiBuffer& target, const MidiMessageSequence& seq, const T
 #endif
 }
 
+void NoteTracker::reset() noexcept
+{
+    zeromem (counts, sizeof (counts));
+    numActive = 0;
+}
+
+void NoteTracker::process (const uint8* data, int size) noexcept
+{
+    if (size < 3)
+        return;
+
+    const uint8 status = data[0] & 0xf0;
+    uint8& count = counts [data[0] & 0x0f][data[1] & 0x7f];
+
+    if (status == 0x90 && data[2] > 0)
+    {
+        if (count < 0xff)
+        {
+            ++count;
+            ++numActive;
+        }
+    }
+    else if ((status == 0x80 || status == 0x90) && count > 0)
+    {
+        --count;
+        --numActive;
+    }
+}
+
+void NoteTracker::add (const NoteTracker& other) noexcept
+{
+    if (other.numActive == 0)
+        return;
+
+    for (int channel = 0; channel < 16; ++channel)
+    {
+        for (int note = 0; note < 128; ++note)
+        {
+            const int count = jmin (0xff - (int) counts [channel][note], (int) other.counts [channel][note]);
+            counts [channel][note] += (uint8) count;
+            numActive += count;
+        }
+    }
+}
+
+void NoteTracker::releaseAll (MidiBuffer& target, int sampleNumber)
+{
+    for (int channel = 0; channel < 16 && numActive > 0; ++channel)
+    {
+        for (int note = 0; note < 128; ++note)
+        {
+            if (counts [channel][note] == 0)
+                continue;
+
+            const uint8 noteOff[3] = { (uint8) (0x80 | channel), (uint8) note, 0 };
+            target.addEvent (noteOff, 3, sampleNumber);
+            numActive -= counts [channel][note];
+            counts [channel][note] = 0;
+        }
+    }
+}
+
+RenderBuffer::RenderBuffer() : generation (0) { }
+RenderBuffer::~RenderBuffer() { }
+
+template <class FramesFromTicks>
+void RenderBuffer::compileWith (const MidiMessageSequence& seq, FramesFromTicks framesFromTicks)
+{
+    enum { blockSize = 64 };
+    uint64 ticks [blockSize], frames [blockSize];
+
+    const int32 numEvents = seq.getNumEvents();
+    events.clearQuick();
+    events.ensureStorageAllocated (numEvents);
+    data.clearQuick();
+
+    for (int32 blockStart = 0; blockStart < numEvents; blockStart += blockSize)
+    {
+        const int32 numInBlock = jmin ((int32) blockSize, numEvents - blockStart);
+        for (int32 j = 0; j < numInBlock; ++j)
+            ticks [j] = static_cast<uint64> (seq.getEventPointer (blockStart + j)->message.getTimeStamp());
+        framesFromTicks (ticks, frames, numInBlock);
+
+        for (int32 j = 0; j < numInBlock; ++j)
+        {
+            const MidiMessage& msg (seq.getEventPointer (blockStart + j)->message);
+            Event ev;
+            ev.frame  = (int64) frames [j];
+            ev.offset = (uint32) data.size();
+            ev.size   = (uint32) msg.getRawDataSize();
+            data.addArray (msg.getRawData(), msg.getRawDataSize());
+            events.add (ev);
+        }
+    }
+}
+
+void RenderBuffer::compile (const MidiMessageSequence& seq, const TimeScale& ts)
+{
+    compileWith (seq, [&ts] (const uint64* ticks, uint64* frames, int numValues)
+    {
+        ts.framesFromTicks (ticks, frames, numValues);
+    });
+}
+
+void RenderBuffer::compile (const MidiMessageSequence& seq, TimeScale::Snapshot* snapshot)
+{
+    // events are sorted, so the cursor only ever steps forward
+    TimeScale::Snapshot::Cursor cursor (snapshot);
+    compileWith (seq, [&cursor] (const uint64* ticks, uint64* frames, int numValues)
+    {
+        for (int i = 0; i < numValues; ++i)
+            frames[i] = cursor.frameFromTick (ticks[i]);
+    });
+}
+
+void RenderBuffer::swapWith (RenderBuffer& other) noexcept
+{
+    events.swapWith (other.events);
+    data.swapWith (other.data);
+    ++generation;
+    ++other.generation;
+}
+
+void RenderBuffer::clear()
+{
+    events.clear();
+    data.clear();
+}
+
+int32 RenderBuffer::getIndexAtFrame (int64 frame) const noexcept
+{
+    int32 lo = 0, hi = events.size();
+    while (lo < hi)
+    {
+        const int32 mid = (lo + hi) >> 1;
+        if (events.getReference (mid).frame < frame)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+int32 RenderBuffer::seek (Cursor& cursor, int64 frame) const noexcept
+{
+    // seek if recompiled or the transport jumped...
+    if (cursor.generation != generation || cursor.frame != frame)
+    {
+        cursor.index      = getIndexAtFrame (frame);
+        cursor.frame      = frame;
+        cursor.generation = generation;
+    }
+
+    return cursor.index;
+}
+
+void RenderBuffer::render (MidiBuffer& target, Cursor& cursor, int64 startFrame, int32 numSamples,
+                           int32 targetOffset, NoteTracker* notes) const
+{
+    const int64 endFrame = startFrame + numSamples;
+    const int32 numEvents = events.size();
+    const Event* const evs = events.begin();
+    int32 i = seek (cursor, startFrame);
+
+    for (; i < numEvents && evs[i].frame < endFrame; ++i)
+    {
+        const uint8* const bytes = data.begin() + evs[i].offset;
+        target.addEvent (bytes, (int) evs[i].size, (int) (evs[i].frame - startFrame) + targetOffset);
+        if (notes != nullptr)
+            notes->process (bytes, (int) evs[i].size);
+    }
+
+    cursor.index = i;
+    cursor.frame = endFrame;
+}
+
 }
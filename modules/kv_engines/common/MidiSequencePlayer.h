@@ -25,9 +25,123 @@ class TimeScale;
 
 namespace Midi {
     void renderSequence (MidiBuffer& target, const MidiMessageSequence& seq, const TimeScale& ts, int32 startFrame, int32 numSamples);
+
+    /** Counts sounding notes per channel so they can be released later,
+        e.g. when a loop wraps or the transport stops. Fixed size and
+        allocation free */
+    class NoteTracker
+    {
+    public:
+        NoteTracker() { reset(); }
+
+        /** Forget all notes without sending anything */
+        void reset() noexcept;
+
+        /** Update from an outgoing message's raw bytes */
+        void process (const uint8* data, int size) noexcept;
+
+        /** Take on the notes sounding in another tracker */
+        void add (const NoteTracker& other) noexcept;
+
+        /** Add a note-off to target for every sounding note, then forget them */
+        void releaseAll (MidiBuffer& target, int sampleNumber);
+
+        inline bool isNoteOn (int channel, int note) const noexcept { return counts [channel - 1][note] > 0; }
+        inline int getNumActive() const noexcept { return numActive; }
+
+    private:
+        uint8 counts [16][128];
+        int numActive;
+    };
+
+    /** A midi sequence compiled for playback against one tempo map
+
+        Events are converted to frames once, then kept in a single array
+        sorted by frame with their bytes packed in a second array. Rendering
+        goes through a Cursor which carries on from the previous block, so
+        steady playback only touches the events it emits.
+
+        Compile again whenever the sequence or the tempo map changes.
+     */
+    class RenderBuffer
+    {
+    public:
+        struct Event
+        {
+            int64  frame;
+            uint32 offset;
+            uint32 size;
+        };
+
+        /** Where a player left off in a RenderBuffer */
+        struct Cursor
+        {
+            Cursor() : index (0), frame (-1), generation (0) { }
+            int32  index;
+            int64  frame;
+            uint32 generation;
+        };
+
+        RenderBuffer();
+        ~RenderBuffer();
+
+        /** Convert a sequence with a time scale. Allocates, so don't call
+            this on the audio thread */
+        void compile (const MidiMessageSequence& seq, const TimeScale& ts);
+
+        /** Convert a sequence with a snapshot of a time scale. Use this off
+            the thread which edits the time scale */
+        void compile (const MidiMessageSequence& seq, TimeScale::Snapshot* snapshot);
+
+        /** Exchange contents with another buffer. Cursors used with this
+            buffer will seek on their next render */
+        void swapWith (RenderBuffer& other) noexcept;
+
+        void clear();
+
+        inline int32 getNumEvents() const noexcept { return events.size(); }
+        inline const Event& getEvent (int32 index) const noexcept { return events.getReference (index); }
+        inline const uint8* getEventData (const Event& ev) const noexcept { return data.begin() + ev.offset; }
+
+        /** Returns the index of the first event at or after a frame */
+        int32 getIndexAtFrame (int64 frame) const noexcept;
+
+        /** Point a cursor at frame, keeping its place if it is already
+            there. Returns the cursor's event index */
+        int32 seek (Cursor& cursor, int64 frame) const noexcept;
+
+        /** Add events from startFrame to startFrame + numSamples to target
+
+            @param targetOffset  Sample in target which startFrame lands on
+            @param notes         If not null, updated with the notes emitted */
+        void render (MidiBuffer& target, Cursor& cursor, int64 startFrame, int32 numSamples,
+                     int32 targetOffset = 0, NoteTracker* notes = nullptr) const;
+
+    private:
+        Array<Event> events;
+        Array<uint8> data;
+        uint32 generation;
+
+        template <class FramesFromTicks>
+        void compileWith (const MidiMessageSequence& seq, FramesFromTicks framesFromTicks);
+
+        JUCE_DECLARE_NON_COPYABLE (RenderBuffer)
+    };
 }
 
-/** A single track midi sequencer with record functionality */
+/** A single track midi sequencer with record functionality
+
+    The sequence repeats every getBarLength() bars while looping. Blocks which
+    cross the loop point get events from both sides, and notes left sounding
+    are released on loop, stop and seek.
+
+    While the shuttle records, incoming events are stamped in ticks and
+    pushed into a preallocated ring on the audio thread. A background thread
+    shared by every player wakes once events arrive, merges them into the
+    sequence and recompiles it.
+
+    Compiled sequences reach the audio thread the way MatrixRouter hands
+    over its plans, so rendering never locks or waits on a compile. */
 class MidiSequencePlayer
 {
 public:
@@ -40,9 +154,33 @@ public:
     void renderSequence (int numSamples, MidiBuffer& midiMessages);
     void renderSequence (MidiBuffer& target, const MidiMessageSequence& seq, int32 startFrame, int32 numSamples);
 
+    /** Compile the player's sequence for the shuttle's current tempo map.
+        Call after editing either one; safe while rendering, and from any
+        thread except the audio thread */
+    void compileSequence();
+
     void prepareToPlay (double sampleRate, int blockSize);
     void releaseResources();
 
+    /** Capture events from a block of input. Called by renderSequence while
+        the shuttle is recording, doesn't lock or allocate */
+    void recordMidi (const MidiBuffer& input, int numSamples);
+
+    /** Move captured events into the sequence, re-pair notes and recompile.
+        This runs on the shared merge thread while prepared, but can be called
+        from any thread except the audio thread. Returns the number merged */
+    int mergeRecording();
+
+    /** Set the size in bytes of the record ring. Don't call while playing */
+    void setRecordBufferSize (int numBytes);
+
+    /** Events lost because the record ring was full */
+    inline int getNumDroppedEvents() const { return numDropped.get(); }
+
+    /** Get the sequence being played. Lock getSequenceLock() while using it */
+    inline const MidiMessageSequence& getSequence() const { return *midiSequence; }
+    inline const CriticalSection& getSequenceLock() const { return sequenceLock; }
+
     /* Get the number of loops that have played since transport time zero (used
        for looping) */
     int32 getLoopRepeatIndex() const;
@@ -58,20 +196,60 @@ public:
     inline int32 getBarLength() const { return numBars; }
     inline void setBarLength (int32 newNumBars) { numBars = newNumBars; }
 
-    /* Get the number of beats per bar (currently hard-coded to four) */
-    int32 getBeatsPerBar() const { return 4; }
+    /* Get the number of beats per bar from the shuttle's time scale */
+    int32 getBeatsPerBar() const;
+
+    /* Loop the sequence every getBarLength() bars, on by default. Takes
+       effect on the next compileSequence() */
+    inline void setLooping (bool shouldLoop) { looping = shouldLoop; }
+    inline bool isLooping() const { return looping; }
 
     inline void setShuttle (Shuttle* s) { shuttle.setNonOwned(s); }
     inline Shuttle* getShuttle() const { return shuttle; }
     inline void setFrameOffset (int32 offset) { frameOffset = offset; }
 
 protected:
-    MidiMessageSequence noteOffs;
     ScopedPointer<MidiMessageSequence> midiSequence;
-    MidiMessage allNotesOff;
 
 private:
     OptionalScopedPointer<Shuttle> shuttle;
+
+    /** A compiled sequence and its loop length, published as one */
+    struct Compiled
+    {
+        Midi::RenderBuffer buffer;
+        int64 loopFrames = 0;
+        Compiled* nextRetired = nullptr;
+    };
+
+    std::atomic<Compiled*> pendingCompiled { nullptr };
+    std::atomic<Compiled*> retiredCompiled { nullptr };
+    Compiled* activeCompiled = nullptr;
+    CriticalSection compileLock;
+
+    Compiled* acquireCompiled() noexcept;
+    void collectGarbage();
+    static void deleteList (Compiled*);
+
+    Midi::RenderBuffer::Cursor cursor;
+    Midi::NoteTracker activeNotes;
+
+    struct RecordHeader
+    {
+        uint64 tick;
+        uint32 size;
+    };
+
+    class RecordMerger;
+    RingBuffer recordRing;
+    TimeScale::Snapshot::Cursor recordCursor;
+    SharedResourcePointer<RecordMerger> merger;
+    std::atomic<bool> mergePending { false };
+    CriticalSection sequenceLock;
+    Atomic<int> numDropped;
+
+    int64 nextFrame;
+    bool looping;
     int32 frameOffset;
     double lastEventTime;
     int32 numBars;
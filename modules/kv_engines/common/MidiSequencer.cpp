@@ -0,0 +1,368 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+struct MidiSequencer::Compiled : public ReferenceCountedObject
+{
+    typedef ReferenceCountedObjectPtr<Compiled> Ptr;
+    Midi::RenderBuffer buffer;
+};
+
+struct MidiSequencer::Track : public ReferenceCountedObject
+{
+    typedef ReferenceCountedObjectPtr<Track> Ptr;
+
+    // message thread only
+    MidiMessageSequence sequence;
+    Compiled::Ptr compiled;
+
+    // set from any thread
+    Atomic<int> muted, solo, transpose, removed;
+
+    // audio thread only
+    Midi::RenderBuffer::Cursor cursor;
+    Midi::NoteTracker notes;
+    bool wasAudible = false;
+    int lastTranspose = 0;
+};
+
+namespace MidiSequencerHelpers
+{
+    static bool isNoteMessage (uint8 status) noexcept
+    {
+        status &= 0xf0;
+        return status == 0x80 || status == 0x90 || status == 0xa0;
+    }
+}
+
+bool MidiSequencer::headComesAfter (const Head& a, const Head& b) noexcept
+{
+    return a.frame != b.frame ? a.frame > b.frame : a.track > b.track;
+}
+
+MidiSequencer::MidiSequencer()
+    : nextFrame (-1),
+      frameOffset (0)
+{
+    shuttle.setOwned (new Shuttle());
+}
+
+MidiSequencer::~MidiSequencer()
+{
+    delete pendingPlan.exchange (nullptr);
+    deleteList (retiredPlans.exchange (nullptr));
+    delete activePlan;
+    activePlan = nullptr;
+    tracks.clear();
+    shuttle.clear();
+}
+
+int MidiSequencer::addTrack (const MidiMessageSequence& seq)
+{
+    Track::Ptr track (new Track());
+    track->sequence = seq;
+    compileTrack (*track);
+    tracks.add (track);
+    publishTracks();
+    return tracks.size() - 1;
+}
+
+void MidiSequencer::setTrackSequence (int index, const MidiMessageSequence& seq)
+{
+    if (Track* const track = tracks.getObjectPointer (index))
+    {
+        track->sequence = seq;
+        compileTrack (*track);
+        publishTracks();
+    }
+}
+
+void MidiSequencer::removeTrack (int index)
+{
+    if (Track* const track = tracks.getObjectPointer (index))
+    {
+        // the audio thread releases its notes once it lets go of the track
+        track->removed = 1;
+        tracks.remove (index);
+        publishTracks();
+    }
+}
+
+void MidiSequencer::clearTracks()
+{
+    for (auto* track : tracks)
+        track->removed = 1;
+    tracks.clear();
+    publishTracks();
+}
+
+int MidiSequencer::getNumTracks() const { return tracks.size(); }
+
+void MidiSequencer::setTrackMuted (int index, bool muted)
+{
+    if (Track* const track = tracks.getObjectPointer (index))
+        track->muted = muted ? 1 : 0;
+}
+
+bool MidiSequencer::isTrackMuted (int index) const
+{
+    const Track* const track = tracks.getObjectPointer (index);
+    return track != nullptr && track->muted.get() != 0;
+}
+
+void MidiSequencer::setTrackSolo (int index, bool solo)
+{
+    if (Track* const track = tracks.getObjectPointer (index))
+        track->solo = solo ? 1 : 0;
+}
+
+bool MidiSequencer::isTrackSolo (int index) const
+{
+    const Track* const track = tracks.getObjectPointer (index);
+    return track != nullptr && track->solo.get() != 0;
+}
+
+void MidiSequencer::setTrackTranspose (int index, int semitones)
+{
+    if (Track* const track = tracks.getObjectPointer (index))
+        track->transpose = jlimit (-127, 127, semitones);
+}
+
+int MidiSequencer::getTrackTranspose (int index) const
+{
+    const Track* const track = tracks.getObjectPointer (index);
+    return track != nullptr ? track->transpose.get() : 0;
+}
+
+void MidiSequencer::compileTracks()
+{
+    for (auto* track : tracks)
+        compileTrack (*track);
+    publishTracks();
+}
+
+void MidiSequencer::compileTrack (Track& track)
+{
+    Compiled::Ptr compiled (new Compiled());
+    compiled->buffer.compile (track.sequence, shuttle->getTimeScale());
+    track.compiled = compiled;
+}
+
+void MidiSequencer::publishTracks()
+{
+    ScopedPointer<Plan> next (new Plan());
+    next->tracks.ensureStorageAllocated (tracks.size());
+    next->compiled.ensureStorageAllocated (tracks.size());
+    for (auto* track : tracks)
+    {
+        next->tracks.add (track);
+        next->compiled.add (track->compiled);
+    }
+
+    next->heads.malloc ((size_t) jmax (1, tracks.size()));
+
+    // anything still pending was never seen by the audio thread
+    delete pendingPlan.exchange (next.release());
+    collectGarbage();
+}
+
+MidiSequencer::Plan* MidiSequencer::acquirePlan() noexcept
+{
+    if (Plan* next = pendingPlan.exchange (nullptr))
+    {
+        if (Plan* old = activePlan)
+        {
+            for (auto* track : old->tracks)
+                if (track->removed.get() != 0)
+                    removedNotes.add (track->notes);
+
+            old->nextRetired = retiredPlans.load();
+            while (! retiredPlans.compare_exchange_weak (old->nextRetired, old))
+                ;
+        }
+
+        // compiled buffers may have changed, so every track seeks again
+        for (auto* track : next->tracks)
+            track->cursor = Midi::RenderBuffer::Cursor();
+
+        activePlan = next;
+    }
+
+    return activePlan;
+}
+
+void MidiSequencer::collectGarbage()
+{
+    deleteList (retiredPlans.exchange (nullptr));
+}
+
+void MidiSequencer::deleteList (Plan* plan)
+{
+    while (plan != nullptr)
+    {
+        Plan* const next = plan->nextRetired;
+        delete plan;
+        plan = next;
+    }
+}
+
+void MidiSequencer::prepareToPlay (double /*sampleRate*/, int /*blockSize*/)
+{
+    // the audio thread forgets sounding notes before its next block
+    resetPending = true;
+    collectGarbage();
+}
+
+void MidiSequencer::releaseResources()
+{
+    collectGarbage();
+}
+
+void MidiSequencer::releaseAll (const Plan& plan, MidiBuffer& target, int sampleNumber)
+{
+    removedNotes.releaseAll (target, sampleNumber);
+    for (auto* track : plan.tracks)
+        track->notes.releaseAll (target, sampleNumber);
+}
+
+void MidiSequencer::renderTracks (int numSamples, MidiBuffer& target)
+{
+    using namespace MidiSequencerHelpers;
+    const Shuttle::State transport (shuttle->getState());
+    Plan* const plan = acquirePlan();
+
+    if (resetPending.exchange (false))
+    {
+        if (plan != nullptr)
+        {
+            for (auto* track : plan->tracks)
+            {
+                track->notes.reset();
+                track->wasAudible = false;
+            }
+        }
+
+        removedNotes.reset();
+        nextFrame = -1;
+    }
+
+    if (plan == nullptr)
+    {
+        removedNotes.releaseAll (target, 0);
+        return;
+    }
+
+    const ReferenceCountedArray<Track>& active = plan->tracks;
+    Head* const heads = plan->heads.getData();
+
+    if (! transport.playing)
+    {
+        releaseAll (*plan, target, 0);
+        nextFrame = -1;
+        return;
+    }
+
+    const int64 startFrame = transport.framePos + frameOffset;
+    const int64 endFrame   = startFrame + numSamples;
+
+    // transport jumped, nothing sounding should carry over...
+    if (startFrame != nextFrame)
+        releaseAll (*plan, target, 0);
+    nextFrame = endFrame;
+    removedNotes.releaseAll (target, 0);
+
+    bool anySolo = false;
+    for (auto* track : active)
+        anySolo |= track->solo.get() != 0;
+
+    // fill the heap with each audible track's first event in the block...
+    int numHeads = 0;
+    for (int i = 0; i < active.size(); ++i)
+    {
+        Track& track = *active.getObjectPointerUnchecked (i);
+        const int transpose = track.transpose.get();
+        const bool audible  = track.muted.get() == 0 && (! anySolo || track.solo.get() != 0);
+
+        if ((track.wasAudible && ! audible) || transpose != track.lastTranspose)
+            track.notes.releaseAll (target, 0);
+
+        track.wasAudible    = audible;
+        track.lastTranspose = transpose;
+
+        if (! audible)
+            continue;
+
+        const Midi::RenderBuffer& buffer = plan->compiled.getObjectPointerUnchecked (i)->buffer;
+        const int32 index = buffer.seek (track.cursor, startFrame);
+        track.cursor.frame = endFrame;
+
+        if (index < buffer.getNumEvents())
+        {
+            const int64 frame = buffer.getEvent (index).frame;
+            if (frame < endFrame)
+            {
+                heads[numHeads++] = { frame, (int32) i };
+                std::push_heap (heads, heads + numHeads, headComesAfter);
+            }
+        }
+    }
+
+    // ...then take events in frame order, refilling from the same track
+    while (numHeads > 0)
+    {
+        std::pop_heap (heads, heads + numHeads, headComesAfter);
+        const Head head = heads[--numHeads];
+
+        Track& track = *active.getObjectPointerUnchecked (head.track);
+        const Midi::RenderBuffer& buffer = plan->compiled.getObjectPointerUnchecked (head.track)->buffer;
+        const Midi::RenderBuffer::Event& ev = buffer.getEvent (track.cursor.index);
+        const uint8* data = buffer.getEventData (ev);
+        uint8 transposed[3];
+
+        if (track.lastTranspose != 0 && ev.size == 3 && isNoteMessage (data[0]))
+        {
+            const int note = (int) data[1] + track.lastTranspose;
+            if (! isPositiveAndBelow (note, 128))
+                data = nullptr;
+            else
+            {
+                transposed[0] = data[0];
+                transposed[1] = (uint8) note;
+                transposed[2] = data[2];
+                data = transposed;
+            }
+        }
+
+        if (data != nullptr)
+        {
+            target.addEvent (data, (int) ev.size, (int) (head.frame - startFrame));
+            track.notes.process (data, (int) ev.size);
+        }
+
+        const int32 next = ++track.cursor.index;
+        if (next < buffer.getNumEvents())
+        {
+            const int64 frame = buffer.getEvent (next).frame;
+            if (frame < endFrame)
+            {
+                heads[numHeads++] = { frame, head.track };
+                std::push_heap (heads, heads + numHeads, headComesAfter);
+            }
+        }
+    }
+}
@@ -0,0 +1,122 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#pragma once
+
+/** A multi-track midi sequencer
+
+    Every track is compiled to a Midi::RenderBuffer against one shared
+    Shuttle. Each block, the next event of every audible track goes into a
+    small heap, and events are popped in frame order into a single
+    MidiBuffer. A block costs O(tracks + events * log tracks), and nothing
+    allocates on the audio thread.
+
+    Mute, solo and transpose can be changed from any thread. Notes still
+    sounding on a track are released when it is silenced or transposed, when
+    the transport stops and when it jumps.
+
+    Adding, removing and compiling tracks happen on the message thread. The
+    track list and its compiled events reach the audio thread the way
+    MidiSequencePlayer hands over its sequence, so rendering never locks.
+ */
+class MidiSequencer
+{
+public:
+    MidiSequencer();
+    ~MidiSequencer();
+
+    /** Add a track playing a copy of seq. Returns the track's index */
+    int addTrack (const MidiMessageSequence& seq);
+
+    /** Replace the events on a track */
+    void setTrackSequence (int track, const MidiMessageSequence& seq);
+
+    /** Remove a track. Later tracks move down one index */
+    void removeTrack (int track);
+
+    /** Remove all tracks */
+    void clearTracks();
+
+    int getNumTracks() const;
+
+    void setTrackMuted (int track, bool muted);
+    bool isTrackMuted (int track) const;
+
+    void setTrackSolo (int track, bool solo);
+    bool isTrackSolo (int track) const;
+
+    /** Shift notes on a track by a number of semitones */
+    void setTrackTranspose (int track, int semitones);
+    int getTrackTranspose (int track) const;
+
+    /** Compile every track for the shuttle's current tempo map. Call this
+        after changing the tempo map; safe while rendering */
+    void compileTracks();
+
+    void prepareToPlay (double sampleRate, int blockSize);
+    void releaseResources();
+
+    /** Merge all audible tracks for the next block into target */
+    void renderTracks (int numSamples, MidiBuffer& target);
+
+    inline void setShuttle (Shuttle* s) { shuttle.setNonOwned (s); }
+    inline Shuttle* getShuttle() const { return shuttle; }
+    inline void setFrameOffset (int32 offset) { frameOffset = offset; }
+
+private:
+    struct Track;
+    struct Compiled;
+    struct Head
+    {
+        int64 frame;
+        int32 track;
+    };
+
+    /** The tracks, their compiled events and room to merge them, published as one */
+    struct Plan
+    {
+        ReferenceCountedArray<Track> tracks;
+        ReferenceCountedArray<Compiled> compiled;
+        HeapBlock<Head> heads;
+        Plan* nextRetired = nullptr;
+    };
+
+    OptionalScopedPointer<Shuttle> shuttle;
+    ReferenceCountedArray<Track> tracks;
+
+    std::atomic<Plan*> pendingPlan { nullptr };
+    std::atomic<Plan*> retiredPlans { nullptr };
+    Plan* activePlan = nullptr;
+    std::atomic<bool> resetPending { false };
+
+    int64 nextFrame;
+    int32 frameOffset;
+
+    Midi::NoteTracker removedNotes;
+
+    static bool headComesAfter (const Head& a, const Head& b) noexcept;
+    void compileTrack (Track& track);
+    void publishTracks();
+    Plan* acquirePlan() noexcept;
+    void collectGarbage();
+    static void deleteList (Plan*);
+    void releaseAll (const Plan& plan, MidiBuffer& target, int sampleNumber);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MidiSequencer)
+};
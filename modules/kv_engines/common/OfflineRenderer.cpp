@@ -0,0 +1,270 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+/** Writes one buffer on a thread of its own while the other fills */
+class OfflineRenderer::Writer : public Thread
+{
+public:
+    enum { chunkSize = 32768 };
+
+    Writer (AudioFormatWriter& w)
+        : Thread ("kv: offline writer"),
+          writer (w),
+          fillIndex (0),
+          writeIndex (0),
+          numToWrite (0),
+          inFlight (false),
+          failed (false)
+    {
+        for (auto& chunk : chunks)
+        {
+            chunk.setSize ((int) writer.getNumChannels(), chunkSize);
+            chunk.clear();
+        }
+
+        startThread (5);
+    }
+
+    ~Writer()
+    {
+        finish();
+    }
+
+    AudioBuffer<float>& getBuffer() noexcept { return chunks [fillIndex]; }
+
+    /** Hand numSamples of the fill buffer to the writer thread, once it has
+        finished with the other one */
+    bool submit (int numSamples)
+    {
+        waitForWrite();
+        if (numSamples <= 0)
+            return ! failed;
+
+        writeIndex = fillIndex;
+        numToWrite = numSamples;
+        inFlight   = true;
+        fillIndex ^= 1;
+        ready.signal();
+        return ! failed;
+    }
+
+    /** Wait for the last write and stop the thread */
+    bool finish()
+    {
+        waitForWrite();
+        signalThreadShouldExit();
+        ready.signal();
+        stopThread (-1);
+        return ! failed;
+    }
+
+private:
+    AudioFormatWriter& writer;
+    AudioBuffer<float> chunks [2];
+    int fillIndex, writeIndex, numToWrite;
+    bool inFlight;
+    std::atomic<bool> failed;
+    WaitableEvent ready, written;
+
+    void waitForWrite()
+    {
+        if (inFlight)
+        {
+            written.wait();
+            inFlight = false;
+        }
+    }
+
+    void run() override
+    {
+        for (;;)
+        {
+            ready.wait();
+            if (threadShouldExit())
+                break;
+
+            if (! writer.writeFromAudioSampleBuffer (chunks [writeIndex], 0, numToWrite))
+                failed = true;
+
+            written.signal();
+        }
+    }
+};
+
+//=============================================================================
+
+class OfflineRenderer::Worker : public Thread
+{
+public:
+    Worker (OfflineRenderer& r, OwnedArray<Job>& j, std::atomic<int>& next)
+        : Thread ("kv: offline render"),
+          renderer (r), jobs (j), nextJob (next) { }
+
+    void run() override
+    {
+        for (int index = nextJob++; index < jobs.size(); index = nextJob++)
+            if (! threadShouldExit())
+                renderer.render (*jobs.getUnchecked (index));
+    }
+
+private:
+    OfflineRenderer& renderer;
+    OwnedArray<Job>& jobs;
+    std::atomic<int>& nextJob;
+};
+
+//=============================================================================
+
+OfflineRenderer::OfflineRenderer (int threads)
+    : numThreads (jmax (1, threads))
+{
+}
+
+OfflineRenderer::~OfflineRenderer() { }
+
+bool OfflineRenderer::render (Job& job)
+{
+    job.completed  = false;
+    job.renderTime = 0.0;
+    job.error.clear();
+
+    AudioProcessor* const processor = job.processor;
+    if (processor == nullptr || job.writer == nullptr || job.blockSize <= 0)
+    {
+        job.error = "Nothing to render";
+        job.writer.reset();
+        return false;
+    }
+
+    const double started    = Time::getMillisecondCounterHiRes();
+    const double sampleRate = job.writer->getSampleRate();
+    const int numIns        = processor->getTotalNumInputChannels();
+    const int numOuts       = processor->getTotalNumOutputChannels();
+
+    processor->setRateAndBufferSizeDetails (sampleRate, job.blockSize);
+    processor->setNonRealtime (true);
+    processor->prepareToPlay (sampleRate, job.blockSize);
+
+    if (job.shuttle != nullptr)
+    {
+        job.shuttle->setSampleRate (sampleRate);
+        job.shuttle->seekAudioFrame (0);
+        job.shuttle->setPlaying (true);
+        job.shuttle->attachAudioThread();
+        processor->setPlayHead (job.shuttle);
+    }
+
+    AudioBuffer<float> block (jmax (1, numIns, numOuts), job.blockSize);
+    MidiBuffer midi;
+    bool ok = true;
+
+    {
+        Writer writer (*job.writer);
+        const int numChannels = jmin (numOuts, writer.getBuffer().getNumChannels());
+        int chunkPos = 0;
+
+        for (int64 pos = 0; pos < job.numSamples; )
+        {
+            if (isCancelled())
+            {
+                job.error = "Cancelled";
+                ok = false;
+                break;
+            }
+
+            const int numSamples = (int) jmin ((int64) job.blockSize, job.numSamples - pos,
+                                               (int64) (Writer::chunkSize - chunkPos));
+
+            AudioBuffer<float> view (block.getArrayOfWritePointers(), block.getNumChannels(), numSamples);
+            view.clear();
+            midi.clear();
+
+            {
+                const ScopedLock sl (processor->getCallbackLock());
+                if (! processor->isSuspended())
+                    processor->processBlock (view, midi);
+            }
+
+            if (job.shuttle != nullptr)
+                job.shuttle->advance (numSamples);
+
+            AudioBuffer<float>& chunk = writer.getBuffer();
+            for (int c = 0; c < numChannels; ++c)
+                chunk.copyFrom (c, chunkPos, view, c, 0, numSamples);
+            for (int c = numChannels; c < chunk.getNumChannels(); ++c)
+                chunk.clear (c, chunkPos, numSamples);
+
+            chunkPos += numSamples;
+            pos += numSamples;
+
+            if (chunkPos == (int) Writer::chunkSize || pos == job.numSamples)
+            {
+                if (! writer.submit (chunkPos))
+                {
+                    job.error = "Could not write audio";
+                    ok = false;
+                    break;
+                }
+
+                chunkPos = 0;
+            }
+        }
+
+        if (! writer.finish() && ok)
+        {
+            job.error = "Could not write audio";
+            ok = false;
+        }
+    }
+
+    processor->releaseResources();
+    processor->setNonRealtime (false);
+    if (job.shuttle != nullptr)
+    {
+        processor->setPlayHead (nullptr);
+        job.shuttle->detachAudioThread();
+    }
+
+    // deleting the writer flushes and closes the file
+    job.writer.reset();
+
+    job.completed  = ok;
+    job.renderTime = (Time::getMillisecondCounterHiRes() - started) * 0.001;
+    return ok;
+}
+
+int OfflineRenderer::renderAll (OwnedArray<Job>& jobs)
+{
+    std::atomic<int> nextJob { 0 };
+    OwnedArray<Worker> workers;
+    reset();
+
+    for (int i = jmin (numThreads, jobs.size()); --i >= 0;)
+        workers.add (new Worker (*this, jobs, nextJob))->startThread (5);
+
+    for (auto* worker : workers)
+        worker->waitForThreadToExit (-1);
+
+    int numCompleted = 0;
+    for (const auto* job : jobs)
+        if (job->completed)
+            ++numCompleted;
+
+    return numCompleted;
+}
@@ -0,0 +1,86 @@
+/*
+    This file is part of the Kushview Modules for JUCE
+    Copyright (c) 2014-2019  Kushview, LLC.  All rights reserved.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#pragma once
+
+/** Renders processors to audio files faster than realtime
+
+    A job pulls its processor block by block, in non-realtime mode, as fast
+    as it will go. Blocks collect in one of two large buffers while a
+    writer thread hands the other to the AudioFormatWriter, so rendering
+    only waits on the disk when the disk is the slower of the two.
+
+    renderAll() spreads a list of jobs over a set of threads, one job per
+    thread at a time.
+ */
+class OfflineRenderer
+{
+public:
+    /** A processor and where its output goes */
+    struct Job
+    {
+        /** Not owned. A processor must only be in one job at a time, and
+            must not be playing anywhere else while the job runs */
+        AudioProcessor* processor = nullptr;
+
+        /** Receives the processor's output channels. Deleted, and so
+            flushed, when the job finishes */
+        std::unique_ptr<AudioFormatWriter> writer;
+
+        int64 numSamples = 0;
+        int blockSize = 512;
+
+        /** Optional. Becomes the processor's play head. It is moved to the
+            start and set playing, then attached to the rendering thread
+            and advanced after every block */
+        Shuttle* shuttle = nullptr;
+
+        // filled in by the renderer
+        bool completed = false;
+        String error;
+        double renderTime = 0.0;    ///< seconds spent rendering and writing
+    };
+
+    /** @param numThreads threads used by renderAll */
+    explicit OfflineRenderer (int numThreads = SystemStats::getNumCpus());
+    ~OfflineRenderer();
+
+    /** Render one job on the calling thread. Returns true if it completed */
+    bool render (Job& job);
+
+    /** Render every job, several at once, and wait for them to finish.
+        Clears an earlier cancel first. Returns the number completed */
+    int renderAll (OwnedArray<Job>& jobs);
+
+    /** Stop jobs in progress and skip the rest. Safe from any thread */
+    void cancel() noexcept { cancelled.store (true); }
+    bool isCancelled() const noexcept { return cancelled.load(); }
+
+    /** Let render() run again after a cancel */
+    void reset() noexcept { cancelled.store (false); }
+
+private:
+    class Writer;
+    class Worker;
+
+    int numThreads;
+    std::atomic<bool> cancelled { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (OfflineRenderer)
+};
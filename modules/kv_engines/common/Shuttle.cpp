@@ -28,111 +28,343 @@ double Shuttle::scaledTick (double sourceTick, const int32 srcPpq)
 }
 
 Shuttle::Shuttle()
+    : publishCount (0),
+      attached (false),
+      positionDuration (-1),
+      commands (256 * (int32) sizeof (Command))
 {
     ts.setTempo (120.0f);
     ts.setSampleRate (44100);
     ts.setTicksPerBeat (Shuttle::PPQ);
     ts.updateScale();
 
-    duration = 0;
-    framePos = 0;
-    framesPerBeat  = Tempo::audioFramesPerBeat ((double) ts.getSampleRate(), ts.getTempo());
-    beatsPerFrame  = 1.0f / framesPerBeat;
+    state.framePos      = 0;
+    state.duration      = 0;
+    state.sampleRate    = (double) ts.getSampleRate();
+    state.tempo         = ts.getTempo();
+    state.framesPerBeat = state.sampleRate * 60.0 / (double) state.tempo;
+    state.beatsPerBar   = ts.beatsPerBar();
+    state.beatDivisor   = ts.beatDivisor();
     playing = recording = false;
     looping = true;
+
+    zerostruct (state.position);
+    state.position.frameRate = AudioPlayHead::fps24;
+    positionCursor.setSnapshot (ts.getSnapshot().get());
+    publish();
+}
+
+Shuttle::~Shuttle()
+{
+    // release snapshots held by commands nobody applied
+    Command command;
+    while (commands.canRead (sizeof (Command)))
+    {
+        commands.read (command);
+        if (command.snapshot != nullptr)
+            command.snapshot->decReferenceCount();
+    }
+}
+
+Shuttle::State Shuttle::getState() const
+{
+    uint64 words [numStateWords];
+
+    for (;;)
+    {
+        // an odd count means a publish is under way...
+        const uint32 count = publishCount.load (std::memory_order_acquire);
+        if ((count & 1) != 0)
+        {
+            Thread::yield();
+            continue;
+        }
+
+        for (int i = 0; i < numStateWords; ++i)
+            words[i] = published[i].load (std::memory_order_relaxed);
+
+        // ...and a changed one that it started while copying
+        std::atomic_thread_fence (std::memory_order_acquire);
+        if (publishCount.load (std::memory_order_relaxed) == count)
+            break;
+    }
+
+    State result;
+    memcpy (&result, words, sizeof (State));
+    return result;
+}
+
+void Shuttle::attachAudioThread()
+{
+    const ScopedLock sl (commandLock);
+    attached = true;
 }
 
-Shuttle::~Shuttle() { }
+void Shuttle::detachAudioThread()
+{
+    const ScopedLock sl (commandLock);
+    attached = false;
+    processCommands();
+}
 
-double Shuttle::getBeatsPerFrame() const { return beatsPerFrame; }
-double Shuttle::getFramesPerBeat() const { return framesPerBeat; }
+// The map counts beats in the time signature's note value, e.g. eighths
+// in 6/8, where hosts expect quarter notes. Ticks always count quarters.
+double Shuttle::quartersPerBeat (const TimeScale::Snapshot::Segment& segment)
+{
+    return 4.0 / (double) (1 << segment.beatDivisor);
+}
+
+double Shuttle::segmentQuarters (const TimeScale::Snapshot::Segment& segment) const
+{
+    return (double) segment.tick / (double) positionCursor.getSnapshot()->ticksPerBeat();
+}
+
+double Shuttle::quartersAtFrame (uint64 frame)
+{
+    const TimeScale::Snapshot::Segment* segment = positionCursor.seekFrame (frame);
+    if (segment == nullptr)
+        return 0.0;
+
+    const double beatsIn = positionCursor.beatPositionAtFrame (frame) - (double) segment->beat;
+    return segmentQuarters (*segment) + beatsIn * quartersPerBeat (*segment);
+}
+
+void Shuttle::updatePosition()
+{
+    CurrentPositionInfo& pos (state.position);
+
+    // the length only needs converting when it or the tempo map changes...
+    if (positionDuration != state.duration)
+    {
+        const uint64 end  = (uint64) jmax ((int64) 0, state.duration);
+        positionDuration  = state.duration;
+        state.lengthBeats = positionCursor.beatPositionAtFrame (end);
+        pos.ppqLoopEnd    = quartersAtFrame (end);
+    }
+
+    const uint64 frame = (uint64) jmax ((int64) 0, state.framePos);
+    pos.ppqPosition = quartersAtFrame (frame);
+
+    if (const TimeScale::Snapshot::Segment* segment = positionCursor.seekFrame (frame))
+    {
+        // bars count from the start of each tempo segment
+        const double beatsPerBar = (double) segment->beatsPerBar;
+        const double beatsIn     = positionCursor.beatPositionAtFrame (frame) - (double) segment->beat;
+        pos.ppqPositionOfLastBarStart = segmentQuarters (*segment)
+            + std::floor (beatsIn / beatsPerBar) * beatsPerBar * quartersPerBeat (*segment);
+        pos.bpm              = (double) segment->tempo;
+        pos.timeSigNumerator = segment->beatsPerBar;
+
+        state.tempo          = segment->tempo;
+        state.framesPerBeat  = state.sampleRate * 60.0 / (double) segment->tempo;
+        state.beatsPerBar    = segment->beatsPerBar;
+        state.beatDivisor    = segment->beatDivisor;
+    }
+
+    pos.timeSigDenominator = 1 << state.beatDivisor;
+    pos.timeInSamples      = state.framePos;
+    pos.timeInSeconds      = (double) state.framePos / state.sampleRate;
+    pos.ppqLoopStart       = 0.0;
+    pos.isPlaying          = state.playing;
+    pos.isRecording        = state.recording;
+    pos.isLooping          = state.looping;
+}
+
+void Shuttle::publish()
+{
+    state.playing   = playing;
+    state.recording = recording;
+    state.looping   = looping;
+    updatePosition();
+
+    uint64 words [numStateWords] = {};
+    memcpy (words, &state, sizeof (State));
+
+    // odd while writing, so readers retry rather than take a torn copy
+    const uint32 count = publishCount.load (std::memory_order_relaxed);
+    publishCount.store (count + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence (std::memory_order_release);
+
+    for (int i = 0; i < numStateWords; ++i)
+        published[i].store (words[i], std::memory_order_relaxed);
+
+    publishCount.store (count + 2, std::memory_order_release);
+}
+
+void Shuttle::post (CommandType type, int64 frames, double value, TimeScale::Snapshot* snapshot)
+{
+    Command command;
+    command.type     = (int32) type;
+    command.frames   = frames;
+    command.value    = value;
+    command.snapshot = snapshot;
+
+    // the command holds a reference until the audio thread applies it
+    if (snapshot != nullptr)
+        snapshot->incReferenceCount();
+
+    const ScopedLock sl (commandLock);
+    if (! attached)
+    {
+        apply (command);
+        publish();
+    }
+    else if (commands.canWrite (sizeof (Command)))
+    {
+        commands.write (command);
+    }
+    else
+    {
+        jassertfalse; // audio thread isn't calling advance or processCommands
+        if (snapshot != nullptr)
+            snapshot->decReferenceCount();
+    }
+}
+
+void Shuttle::processCommands()
+{
+    Command command;
+    while (commands.canRead (sizeof (Command)))
+    {
+        commands.read (command);
+        apply (command);
+    }
+
+    publish();
+}
+
+void Shuttle::apply (const Command& command)
+{
+    switch (command.type)
+    {
+        case SetPlaying:    playing   = command.frames != 0; break;
+        case SetRecording:  recording = command.frames != 0; break;
+        case SetLooping:    looping   = command.frames != 0; break;
+        case SeekFrame:     state.framePos  = command.frames; break;
+
+        case TempoMapChanged:
+        {
+            // keep the position and length in beats, measured on the old map
+            const double positionBeats = positionCursor.beatPositionAtFrame ((uint64) jmax ((int64) 0, state.framePos));
+            const double lengthBeats   = positionCursor.beatPositionAtFrame ((uint64) jmax ((int64) 0, state.duration));
+
+            positionCursor.setSnapshot (command.snapshot);
+            state.framePos = (int64) positionCursor.frameAtBeatPosition (positionBeats);
+            if (state.duration > 0)
+                state.duration = (int64) positionCursor.frameAtBeatPosition (lengthBeats);
+            positionDuration = -1;
+        } break;
+
+        case SetSampleRate:
+        {
+            // keep the position and length in seconds
+            const double oldRate = state.sampleRate;
+            state.sampleRate    = command.value;
+            state.framePos      = llrint ((double) state.framePos * state.sampleRate / oldRate);
+            state.duration      = llrint ((double) state.duration * state.sampleRate / oldRate);
+            positionCursor.setSnapshot (command.snapshot);
+            positionDuration    = -1;
+        } break;
+
+        case SetLengthFrames:   state.duration = command.frames; break;
+        case SetLengthBeats:    state.duration = (int64) positionCursor.frameAtBeatPosition (command.value); break;
+        case SetLengthSeconds:  state.duration = llrint (command.value * state.sampleRate); break;
+
+        default: jassertfalse; break;
+    }
+
+    if (command.snapshot != nullptr)
+        command.snapshot->decReferenceCount();
+}
+
+double Shuttle::getBeatsPerFrame() const { return 1.0 / getState().framesPerBeat; }
+double Shuttle::getFramesPerBeat() const { return getState().framesPerBeat; }
 
 bool Shuttle::getCurrentPosition (CurrentPositionInfo &result)
 {
-    result.bpm          = (double) ts.getTempo();
-    result.frameRate    = AudioPlayHead::fps24;
-
-    result.isLooping    = isLooping();
-    result.isPlaying    = isPlaying();
-    result.isRecording  = isRecording();
-
-    result.ppqLoopStart = 0.0f; // ppqLoopStart;
-    result.ppqLoopEnd   = 0.0f; // ppqLoopEnd;
-    result.ppqPosition  = getPositionBeats();
-    result.ppqPositionOfLastBarStart = 0.0f;
-
-    result.editOriginTime       = 0.0f;
-    
-    result.timeInSamples        = getPositionFrames();
-    result.timeInSeconds        = getPositionSeconds();
-    result.timeSigNumerator     = ts.beatsPerBar();
-    result.timeSigDenominator   = (1 << ts.beatDivisor());
-    
+    result = getState().position;
     return true;
 }
 
-const double Shuttle::getLengthBeats()      const { return getLengthSeconds() * (getTempo() / 60.0f); }
-const int64  Shuttle::getLengthFrames()     const { return duration; }
-const double Shuttle::getLengthSeconds()    const { return (double) duration / (double) ts.getSampleRate(); }
+const double Shuttle::getLengthBeats()      const { return getState().lengthBeats; }
+const int64  Shuttle::getLengthFrames()     const { return getState().duration; }
+const double Shuttle::getLengthSeconds()    const { const State s (getState()); return (double) s.duration / s.sampleRate; }
 
-const double Shuttle::getPositionBeats()    const { return getPositionSeconds() * (getTempo() / 60.0f); }
-const int64  Shuttle::getPositionFrames()   const { return framePos; }
-const double Shuttle::getPositionSeconds()  const { return (double) framePos / (double) ts.getSampleRate(); }
+const double Shuttle::getPositionBeats()    const { return getState().position.ppqPosition; }
+const int64  Shuttle::getPositionFrames()   const { return getState().framePos; }
+const double Shuttle::getPositionSeconds()  const { const State s (getState()); return (double) s.framePos / s.sampleRate; }
 
-int64  Shuttle::getRemainingFrames()        const { return getLengthFrames() - framePos; }
-double Shuttle::getSampleRate()             const { return (double) ts.getSampleRate(); }
-float  Shuttle::getTempo()                  const { return ts.getTempo(); }
+int64  Shuttle::getRemainingFrames()        const { const State s (getState()); return s.duration - s.framePos; }
+double Shuttle::getSampleRate()             const { return getState().sampleRate; }
+float  Shuttle::getTempo()                  const { return getState().tempo; }
 const TimeScale& Shuttle::getTimeScale()    const { return ts; }
 
-bool Shuttle::isLooping()                   const { return looping; }
-bool Shuttle::isPlaying()                   const { return playing; }
-bool Shuttle::isRecording()                 const { return recording; }
+bool Shuttle::isLooping()                   const { return getState().looping; }
+bool Shuttle::isPlaying()                   const { return getState().playing; }
+bool Shuttle::isRecording()                 const { return getState().recording; }
+
+void Shuttle::setPlaying (bool shouldPlay)      { post (SetPlaying, shouldPlay ? 1 : 0); }
+void Shuttle::setRecording (bool shouldRecord)  { post (SetRecording, shouldRecord ? 1 : 0); }
+void Shuttle::setLooping (bool shouldLoop)      { post (SetLooping, shouldLoop ? 1 : 0); }
+void Shuttle::seekAudioFrame (int64 frame)      { post (SeekFrame, frame); }
 
 void Shuttle::resetRecording()
 {
-    // TODO:
+    post (SetRecording, 0);
 }
 
-void Shuttle::setLengthBeats   (const float beats) { setLengthFrames (framesPerBeat * beats); }
-void Shuttle::setLengthSeconds (const double seconds) { setLengthFrames (roundToInt (getSampleRate() * seconds)); }
-void Shuttle::setLengthFrames  (const uint32 df) { duration = df; }
+void Shuttle::setLengthBeats   (const float beats) { post (SetLengthBeats, 0, (double) beats); }
+void Shuttle::setLengthSeconds (const double seconds) { post (SetLengthSeconds, 0, seconds); }
+void Shuttle::setLengthFrames  (const uint32 df) { post (SetLengthFrames, (int64) df); }
 
 void Shuttle::setTempo (float bpm)
 {
     if (ts.getTempo() != bpm && bpm > 0.0f)
     {
-        double oldTime = getPositionBeats();
-        double oldLen  = getLengthBeats();
-
         ts.setTempo (bpm);
         ts.updateScale();
-        framesPerBeat = (double) Tempo::audioFramesPerBeat ((double) ts.getSampleRate(), ts.getTempo());
-
-        beatsPerFrame  = 1.0f / framesPerBeat;
-        framePos = llrint (oldTime * framesPerBeat);
-        duration = (uint32) llrint (oldLen * framesPerBeat);
+        post (TempoMapChanged, 0, 0.0, ts.getSnapshot().get());
     }
 }
 
+void Shuttle::setTimeScale (const TimeScale& newScale)
+{
+    const unsigned int sampleRate = ts.getSampleRate();
+    ts.copyFrom (newScale);
+    ts.setSampleRate (sampleRate);
+    ts.setTicksPerBeat (Shuttle::PPQ);
+    ts.updateScale();
+    post (TempoMapChanged, 0, 0.0, ts.getSnapshot().get());
+}
+
 void Shuttle::setSampleRate (double rate)
 {
-    if (sampleRate == rate)
+    if ((double) ts.getSampleRate() == rate || rate <= 0.0)
         return;
 
-    const double oldTime = getPositionSeconds();
-    const double oldLenSec = (double) getLengthSeconds();
-    ts.setSampleRate (rate);
+    ts.setSampleRate ((unsigned int) rate);
     ts.updateScale();
-
-    framePos       = llrint (oldTime * ts.getSampleRate());
-    duration       = (uint32) (oldLenSec * (float) ts.getSampleRate());
-    framesPerBeat  = Tempo::audioFramesPerBeat (ts.getSampleRate(), ts.getTempo());
-    beatsPerFrame  = 1.0f / framesPerBeat;
+    post (SetSampleRate, 0, rate, ts.getSnapshot().get());
 }
 
 void Shuttle::advance (int nframes)
 {
-    framePos += nframes;
-    if (duration > 0 && framePos >= duration)
-        framePos = framePos - duration;
+    state.framePos += nframes;
+    if (state.duration > 0 && state.framePos >= state.duration)
+        state.framePos = state.framePos - state.duration;
+
+    processCommands();
+}
+
+void Shuttle::advanceTo (int64 frame)
+{
+    state.framePos = frame;
+    if (state.duration > 0)
+    {
+        state.framePos %= state.duration;
+        if (state.framePos < 0)
+            state.framePos += state.duration;
+    }
+
+    processCommands();
 }
@@ -19,7 +19,20 @@
 
 #pragma once
 
-/** A mini-transport for use in a processable that can loop */
+/** A mini-transport for use in a processable that can loop
+
+    Until an audio thread is attached, setters take effect straight away and
+    getters return the new values. Call setters and advance() from one
+    thread at a time then.
+
+    Between attachAudioThread() and detachAudioThread(), setters may be
+    called from any thread but only queue a command. The audio thread
+    applies it at the next block boundary, in advance() or
+    processCommands(), so getters return the old value until then.
+
+    After each block the state is published behind a sequence counter.
+    Getters retry until they copy it between two publishes, so reads never
+    block and never see half an update. */
 class Shuttle : public AudioPlayHead
 {
 public:
@@ -35,13 +48,46 @@ public:
         double timeInBeats;
     };
 
+    /** Transport state as of the last block boundary */
+    struct State
+    {
+        int64  framePos;
+        int64  duration;
+        double sampleRate;
+        double framesPerBeat;   ///< at the play position
+        float  tempo;           ///< at the play position
+        int    beatsPerBar;
+        int    beatDivisor;
+        bool   playing, recording, looping;
+
+        /** Worked out from the tempo map after every block */
+        CurrentPositionInfo position;
+        double lengthBeats;
+    };
+
     Shuttle();
     ~Shuttle();
 
+    /** Returns a consistent copy of the published state */
+    State getState() const;
+
+    /** Queue setters for an audio thread from now on. Call before it starts
+        calling advance() or processCommands(). It must keep doing so, up
+        to 256 commands can wait between blocks */
+    void attachAudioThread();
+
+    /** Apply setters straight away again. Call once the audio thread has
+        stopped; commands still queued are applied first */
+    void detachAudioThread();
+
     bool isLooping()   const;
     bool isPlaying()   const;
     bool isRecording() const;
 
+    void setPlaying (bool shouldPlay);
+    void setRecording (bool shouldRecord);
+    void setLooping (bool shouldLoop);
+
     double getFramesPerBeat() const;
     double getBeatsPerFrame() const;
 
@@ -62,34 +108,96 @@ public:
     
     void resetRecording();
 
+    /** The tempo map. Only edited from the thread calling setTempo,
+        setTimeScale and setSampleRate; use TimeScale::getSnapshot on the
+        audio thread */
     const TimeScale& getTimeScale() const;
+
+    /** Replace the tempo map. The play position and length keep their
+        place in beats */
+    void setTimeScale (const TimeScale& newScale);
+
+    /** Returns the tempo at the play position */
     float getTempo() const;
+
+    /** Set the tempo of the first tempo node */
     void setTempo (float bpm);
 
     double getSampleRate() const;
     void setSampleRate (double rate);
     
+    /** Move the play position after a block, then apply queued commands.
+        Call from the audio thread only */
     void advance (int nframes);
-    inline void seekAudioFrame (int64 frame)
-    {
-        framePos = frame;
-    }
+
+    /** Move the play position straight to frame after a block, e.g. to
+        follow an external clock, then apply queued commands. Call from
+        the audio thread only */
+    void advanceTo (int64 frame);
+
+    /** Apply queued commands and publish the state. Called by advance(),
+        call it directly from the audio thread when not advancing */
+    void processCommands();
+
+    void seekAudioFrame (int64 frame);
     
     bool getCurrentPosition (CurrentPositionInfo &result);
 
 protected:
     kv::TimeScale ts;
+
+    /** The transport flags, published with the rest of the state. Change
+        them from the audio thread, or from the owner's thread while no
+        audio thread is attached */
     bool playing, recording, looping;
 
 private:
-    double framesPerBeat;
-    double beatsPerFrame;
+    enum CommandType
+    {
+        SetPlaying = 0,
+        SetRecording,
+        SetLooping,
+        SeekFrame,
+        TempoMapChanged,
+        SetSampleRate,
+        SetLengthFrames,
+        SetLengthBeats,
+        SetLengthSeconds
+    };
 
-    int64 framePos;
-    uint32 duration;
-    double sampleRate;
-    
+    struct Command
+    {
+        int32  type;
+        int64  frames;
+        double value;
+
+        /** The tempo map to move to, referenced until the command is
+            applied. The audio thread only changes maps here, so positions
+            are always measured on the map they came from */
+        TimeScale::Snapshot* snapshot;
+    };
 
-    double ppqLoopStart;
-    double ppqLoopEnd;
+    State state;            ///< audio thread's working copy
+
+    // the published state, copied a word at a time so a reader racing the
+    // audio thread is detected by the counter rather than undefined
+    static const int numStateWords = (int) ((sizeof (State) + sizeof (uint64) - 1) / sizeof (uint64));
+    std::atomic<uint64> published [numStateWords];
+    std::atomic<uint32> publishCount;
+    bool attached;
+
+    TimeScale::Snapshot::Cursor positionCursor;
+    int64 positionDuration;
+
+    RingBuffer commands;
+    CriticalSection commandLock;
+
+    void post (CommandType type, int64 frames, double value = 0.0,
+               TimeScale::Snapshot* snapshot = nullptr);
+    void apply (const Command& command);
+    void publish();
+    void updatePosition();
+    double quartersAtFrame (uint64 frame);
+    double segmentQuarters (const TimeScale::Snapshot::Segment& segment) const;
+    static double quartersPerBeat (const TimeScale::Snapshot::Segment& segment);
 };
@@ -51,7 +51,6 @@ public:
         : AudioIODevice (deviceName, "JACK"),
           inputId (inId),
           outputId (outId),
-          callback (nullptr),
           client (client_)
     {}
 
@@ -139,22 +138,25 @@ public:
 
     void start (AudioIODeviceCallback* newCallback) override
     {
-        if (client.isOpen() && newCallback != callback)
+        if (client.isOpen() && newCallback != callbacks.get())
         {
             if (newCallback != nullptr)
                 newCallback->audioDeviceAboutToStart (this);
 
-            AudioIODeviceCallback* const oldCallback = callback;
-            {
-                const ScopedLock sl (callbackLock);
-                callback = newCallback;
+            // JACK drops clients whose cycles run this long, so don't hang on one
+            AudioIODeviceCallback* oldCallback = nullptr;
+            const bool released = callbacks.swap (newCallback, oldCallback, 1000);
 
-                if (callback != nullptr)
-                    client.activate();
-            }
+            if (newCallback != nullptr)
+                client.activate();
+
+            if (oldCallback == nullptr)
+                return;
 
-            if (oldCallback != nullptr)
+            if (released)
                 oldCallback->audioDeviceStopped();
+            else
+                Logger::writeToLog ("[KV] jack: process cycle didn't finish, the old callback wasn't stopped");
         }
     }
 
@@ -164,7 +166,7 @@ public:
         client.deactivate();
     }
 
-    bool isPlaying() override { return callback != nullptr; }
+    bool isPlaying() override { return callbacks.get() != nullptr; }
 
     String getLastError()             override { return lastError; }
 
@@ -222,8 +224,7 @@ private:
     String inputId, outputId;
     JackClient& client;
     String lastError;
-    AudioIODeviceCallback* callback;
-    CriticalSection callbackLock;
+    AudioCallbackHandoff callbacks;
 
     BigInteger activeIns, activeOuts;
     Array<JackPort::Ptr> audioIns;
@@ -247,14 +248,9 @@ private:
         for (int i = audioOuts.size(); --i >= 0;)
             outputs[i] = (float*) audioOuts.getUnchecked(i)->getBuffer (nframes);
 
-        const ScopedLock sl (callbackLock);
-        if (callback != nullptr)
-        {
-            callback->audioDeviceIOCallback (
-                (const float**)inputs, numIns, (float**)outputs, numOuts, 
-                static_cast<int> (nframes)
-            );
-        }
+        // never blocks, see AudioCallbackHandoff
+        callbacks.process ((const float**)inputs, numIns, (float**)outputs, numOuts,
+                           static_cast<int> (nframes));
     }
 
     static int processCallback (jack_nframes_t nframes, void* arg)
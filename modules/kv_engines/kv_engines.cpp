@@ -19,9 +19,20 @@
 
 #include "kv_engines.h"
 
+#if JUCE_INTEL
+ #include <emmintrin.h>
+#endif
+
 namespace kv {
 
+#include "common/AudioCallbackHandoff.cpp"
+#include "common/ClockSync.cpp"
+#include "common/DummyAudioDevice.cpp"
+#include "common/GraphBufferPlanner.cpp"
+#include "common/GraphRenderScheduler.cpp"
 #include "common/MidiSequencePlayer.cpp"
+#include "common/MidiSequencer.cpp"
+#include "common/OfflineRenderer.cpp"
 #include "common/Processor.cpp"
 #include "common/Shuttle.cpp"
 
@@ -26,7 +26,7 @@
     website:          https://kushview.net
     license:          GPL v2
 
-    dependencies:     kv_core, juce_data_structures, juce_audio_processors, juce_audio_devices
+    dependencies:     kv_core, juce_data_structures, juce_audio_formats, juce_audio_processors, juce_audio_devices
 
     END_JUCE_MODULE_DECLARATION
  */
@@ -36,6 +36,7 @@
 
 #include <juce_gui_extra/juce_gui_extra.h>
 #include <juce_audio_devices/juce_audio_devices.h>
+#include <juce_audio_formats/juce_audio_formats.h>
 #include <juce_audio_processors/juce_audio_processors.h>
 #include <kv_models/kv_models.h>
 
@@ -55,9 +56,16 @@
 
 namespace kv {
 
+#include "common/GraphBufferPlanner.h"
+#include "common/GraphRenderScheduler.h"
 #include "common/Processor.h"
 #include "common/MidiSequencePlayer.h"
+#include "common/MidiSequencer.h"
 #include "common/Shuttle.h"
+#include "common/ClockSync.h"
+#include "common/AudioCallbackHandoff.h"
+#include "common/DummyAudioDevice.h"
+#include "common/OfflineRenderer.h"
 
 #if KV_JACK_AUDIO
  #ifndef KV_JACK_NAME
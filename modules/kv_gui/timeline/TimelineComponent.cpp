@@ -299,35 +299,29 @@ void TimelineComponent::paint (Graphics& g)
 #if 0
     // paint grid lines
     g.saveState();
-    g.setColour (Colours::white);
+    g.reduceClipRegion (mTrackWidth + 2, 0, getWidth() - mTrackWidth - 2, getHeight());
 
-    for (int beat = scale.beatFromPixel (timeToX (timeSpan.getStart())) - 1;
-         ++beat;)
+    const int originX = mTrackWidth + pixelOffset;
+    TimeScale::GridIterator grid (scale, -pixelOffset, getWidth() - originX);
+    while (grid.next())
     {
-        const int pixel = scale.pixelFromBeat (beat) + mTrackWidth;
+        const int pixel = grid.pixel() + originX;
 
-        if (pixel < 0)
-            continue;
-
-        if (scale.beatIsBar (beat))
+        if (grid.type() == TimeScale::GridIterator::Bar)
         {
-            g.saveState();
-            g.setColour(Colours::white);
-            g.drawText (String(beat), pixel, 0, 20, 16, Justification::left, true);
-            g.restoreState();
-            g.setOpacity (0.20);
+            g.setColour (Colours::white);
+            g.drawText (String (grid.bar() + 1), pixel + 2, 0, 20, 16, Justification::left, true);
+            g.setColour (Colours::white.withAlpha (0.20f));
         }
         else
-            g.setOpacity (0.10);
+        {
+            g.setColour (Colours::white.withAlpha (0.10f));
+        }
 
         g.drawVerticalLine (pixel, 0, getHeight());
-
-        if (pixel > getWidth())
-            break;
     }
 
     g.restoreState();
-    g.resetToDefaultState();
 #endif
 
 }